@@ -0,0 +1,702 @@
+/*
+ * Load generator for the timer engines.
+ *
+ * Every run creates a number of one-shot timers from several producer
+ * threads and waits until all of them fired (the "fire" scenario), or creates
+ * and cancels them right away like RPC timeouts that are rarely hit (the
+ * "churn" scenario). One result line is printed per run, as CSV or JSON
+ * lines, so runs on different commits and machines can be diffed.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/perf_event.h>
+#include "timewheel.h"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION          "unknown"
+#endif
+
+#define BENCH_MAX_VALUES        16
+#define BENCH_MAX_PRODUCERS     64
+#define BENCH_DRAIN_GRACE_MS    5000    /* how long past the last deadline a run may take */
+
+typedef enum BenchEngine {
+        BENCH_ENGINE_WHEEL = 0, /* timewheel, TIMEWHEEL_MODE_TICK */
+        BENCH_ENGINE_TICKLESS, /* timewheel, TIMEWHEEL_MODE_TICKLESS */
+        BENCH_ENGINE_LIST, /* event list, linear scan */
+        BENCH_ENGINE_HEAP, /* event list, 4-ary heap */
+        BENCH_ENGINE_MANUAL, /* timewheel, TIMEWHEEL_MODE_MANUAL advanced as fast as it goes */
+        BENCH_ENGINE_COUNT,
+} BenchEngine_t;
+
+typedef enum BenchScenario {
+        BENCH_SCENARIO_FIRE = 0, /* one-shot timers, wait until all fired */
+        BENCH_SCENARIO_CHURN, /* create and cancel right away */
+} BenchScenario_t;
+
+static const char *g_engineNames[BENCH_ENGINE_COUNT] = { "wheel", "tickless", "list", "heap", "manual" };
+
+/* Per-timer argument, arg_t first because the list engine reads its due time from it */
+typedef struct BenchArg {
+        arg_t base;
+        uint64_t dueNs; /* CLOCK_MONOTONIC time the timer should fire */
+        uint32_t fired;
+} BenchArg_t;
+
+/* One run of the sweep */
+typedef struct BenchRun {
+        BenchEngine_t engine;
+        BenchScenario_t scenario;
+        uint32_t events;
+        uint32_t producers;
+        uint32_t stepUs;
+        uint32_t batch; /* timers per timewheel_create_events() call, 1 creates them one by one */
+        uint32_t maxIntervalMs;
+        int rtPriority; /* SCHED_FIFO priority of the loop thread, with prefaulted events and mlockall(); 0 for a default thread */
+
+        TimeWheel_t *wheel;
+        EventList_t *eventList;
+        BenchArg_t *args;
+        int64_t *lateNs; /* fire minus due of every timer, first run only */
+        uint32_t firedCount;
+} BenchRun_t;
+
+static BenchRun_t *g_run; /* the run in progress, read by the callbacks */
+
+typedef struct BenchProducer {
+        BenchRun_t *run;
+        uint32_t first;
+        uint32_t count;
+        int ret;
+} BenchProducer_t;
+
+/* Results of one run */
+typedef struct BenchResult {
+        double opsPerSec;
+        double p50Us;
+        double p99Us;
+        double p999Us;
+        double drainMs; /* last create until every timer fired */
+        long rssKb;
+        long long cacheMisses; /* hardware cache misses of the whole run, -1 without perf counters */
+        double cpuPct;
+        long minorFaults; /* page faults of the whole process during the run */
+        uint32_t fired;
+} BenchResult_t;
+
+static uint64_t nowNs(clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static long minorFaults(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+static uint64_t cpuTimeUs(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+            (uint64_t) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+/* resident set in kB, the current value rather than the peak so runs do not inherit each other's */
+static long residentKb(void)
+{
+    long size = 0;
+    long pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%ld %ld", &size, &pages) != 2)
+        {
+            pages = 0;
+        }
+        fclose(fp);
+    }
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * Hardware cache miss counter of this process, inherited by the threads the
+ * engines start afterwards. -1 if the kernel or a VM does not expose it.
+ */
+static int cacheMissOpen(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long cacheMissClose(int fd)
+{
+    uint64_t count = 0;
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (read(fd, &count, sizeof(count)) != (ssize_t) sizeof(count))
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    return (long long) count;
+}
+
+static int benchIsWheel(BenchEngine_t engine)
+{
+    return engine == BENCH_ENGINE_WHEEL || engine == BENCH_ENGINE_TICKLESS || engine == BENCH_ENGINE_MANUAL;
+}
+
+/* a manual wheel runs on virtual time, its timers are late against that clock only */
+static uint64_t benchNowNs(const BenchRun_t *run)
+{
+    return run->engine == BENCH_ENGINE_MANUAL ? timewheel_now_us(run->wheel) * 1000ULL : nowNs(CLOCK_MONOTONIC);
+}
+
+static void benchCallback(void *arg)
+{
+    BenchArg_t *benchArg = (BenchArg_t*) arg;
+    int64_t lateNs = (int64_t) (benchNowNs(g_run) - benchArg->dueNs);
+
+    /* the event list engines are periodic, only the first run is measured */
+    if (__atomic_exchange_n(&benchArg->fired, 1, __ATOMIC_RELAXED) != 0)
+    {
+        return;
+    }
+
+    g_run->lateNs[benchArg->base.id] = lateNs;
+    __atomic_add_fetch(&g_run->firedCount, 1, __ATOMIC_RELEASE);
+}
+
+/* spread the intervals over [one tick, maxIntervalMs] so every wheel level is used */
+static uint32_t benchIntervalUs(const BenchRun_t *run, uint32_t i)
+{
+    uint32_t ticks = run->maxIntervalMs * 1000 / run->stepUs;
+
+    return (uint32_t) (((uint64_t) i * 2654435761ULL) % ticks + 1) * run->stepUs;
+}
+
+/* spec of wheel timer i */
+static void benchWheelSpec(BenchRun_t *run, uint32_t i, TimeWheelEventSpec_t *spec)
+{
+    BenchArg_t *benchArg = &run->args[i];
+    uint32_t intervalUs = benchIntervalUs(run, i);
+
+    memset(benchArg, 0, sizeof(BenchArg_t));
+    benchArg->base.id = i;
+    benchArg->dueNs = benchNowNs(run) + (uint64_t) intervalUs * 1000;
+
+    timewheel_event_spec_default(spec, 0, benchCallback, benchArg);
+    spec->intervalUs = intervalUs;
+    /* a churned timer stays periodic so its handle is still valid when it is cancelled */
+    spec->repeat = run->scenario == BENCH_SCENARIO_CHURN ? 0 : 1;
+}
+
+/* create wheel timers first .. first + count - 1 with one timewheel_create_events() call */
+static int benchCreateBatch(BenchRun_t *run, uint32_t first, uint32_t count, TimeWheelEventSpec_t *specs,
+        TimeWheelHandle_t *handles)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        benchWheelSpec(run, first + i, &specs[i]);
+    }
+
+    if (timewheel_create_events(run->wheel, specs, count, handles) != 0)
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; run->scenario == BENCH_SCENARIO_CHURN && i < count; i++)
+    {
+        if (timewheel_cancel_event(run->wheel, handles[i]) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int benchCreate(BenchRun_t *run, uint32_t i)
+{
+    if (benchIsWheel(run->engine))
+    {
+        TimeWheelEventSpec_t spec;
+        TimeWheelHandle_t handle;
+
+        benchWheelSpec(run, i, &spec);
+        if (timewheel_create_event_ex(run->wheel, &spec, &handle) != 0)
+        {
+            return -1;
+        }
+
+        return run->scenario == BENCH_SCENARIO_CHURN ? timewheel_cancel_event(run->wheel, handle) : 0;
+    }
+
+    BenchArg_t *benchArg = &run->args[i];
+    uint32_t intervalUs = benchIntervalUs(run, i);
+
+    memset(benchArg, 0, sizeof(BenchArg_t));
+    benchArg->base.id = i;
+
+    /* the event lists tick in milliseconds on CLOCK_REALTIME */
+    Event_t *event = NULL;
+    uint32_t intervalMs = (intervalUs + 999) / 1000;
+
+    benchArg->base.interval = intervalMs;
+    benchArg->base.startTimeMs = nowNs(CLOCK_REALTIME) / 1000000;
+    benchArg->base.nextTimemMs = benchArg->base.startTimeMs + intervalMs;
+    benchArg->dueNs = nowNs(CLOCK_MONOTONIC) + (uint64_t) intervalMs * 1000000;
+    if (eventList_addEventEx(run->eventList, intervalMs, benchCallback, benchArg, &event) != 0)
+    {
+        return -1;
+    }
+
+    return run->scenario == BENCH_SCENARIO_CHURN ? eventList_cancelEvent(run->eventList, event) : 0;
+}
+
+static void* benchProducer(void *arg)
+{
+    BenchProducer_t *producer = (BenchProducer_t*) arg;
+
+    BenchRun_t *run = producer->run;
+
+    producer->ret = 0;
+    if (run->batch > 1 && benchIsWheel(run->engine))
+    {
+        TimeWheelEventSpec_t *specs = (TimeWheelEventSpec_t*) malloc(sizeof(TimeWheelEventSpec_t) * run->batch);
+        TimeWheelHandle_t *handles = (TimeWheelHandle_t*) malloc(sizeof(TimeWheelHandle_t) * run->batch);
+
+        producer->ret = specs != NULL && handles != NULL ? 0 : -1;
+        for (uint32_t i = producer->first; producer->ret == 0 && i < producer->first + producer->count; i += run->batch)
+        {
+            uint32_t count = producer->first + producer->count - i < run->batch ? producer->first + producer->count - i : run->batch;
+            producer->ret = benchCreateBatch(run, i, count, specs, handles);
+        }
+
+        free(specs);
+        free(handles);
+        return NULL;
+    }
+
+    for (uint32_t i = producer->first; i < producer->first + producer->count; i++)
+    {
+        if (benchCreate(run, i) != 0)
+        {
+            producer->ret = -1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int compareLate(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentileUs(const int64_t *sorted, uint32_t count, double percentile)
+{
+    if (count == 0)
+    {
+        return 0.0;
+    }
+
+    uint32_t index = (uint32_t) (percentile / 100.0 * (count - 1) + 0.5);
+    return (double) sorted[index] / 1000.0;
+}
+
+static int benchStart(BenchRun_t *run)
+{
+    if (benchIsWheel(run->engine))
+    {
+        TimeWheelConfig_t config;
+
+        timewheel_config_default(&config, 1, 1);
+        config.stepUs = run->stepUs;
+        config.mode = run->engine == BENCH_ENGINE_TICKLESS ? TIMEWHEEL_MODE_TICKLESS :
+                run->engine == BENCH_ENGINE_MANUAL ? TIMEWHEEL_MODE_MANUAL : TIMEWHEEL_MODE_TICK;
+        if (run->rtPriority != 0)
+        {
+            config.thread.policy = SCHED_FIFO;
+            config.thread.priority = run->rtPriority;
+            config.prefaultEvents = run->events;
+            config.lockMemory = 1;
+        }
+        run->wheel = timewheel_create_ex(&config);
+        return run->wheel != NULL ? 0 : -1;
+    }
+
+    run->eventList = (EventList_t*) calloc(1, sizeof(EventList_t));
+    if (run->eventList == NULL)
+    {
+        return -1;
+    }
+
+    TimeWheelThreadConfig_t thread;
+    memset(&thread, 0, sizeof(TimeWheelThreadConfig_t));
+    if (run->rtPriority != 0)
+    {
+        thread.policy = SCHED_FIFO;
+        thread.priority = run->rtPriority;
+    }
+
+    if (eventListInitAttr(run->eventList, run->engine == BENCH_ENGINE_HEAP ? EVENTLIST_ENGINE_HEAP : EVENTLIST_ENGINE_LIST,
+            &thread) != 0)
+    {
+        free(run->eventList);
+        run->eventList = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void benchStop(BenchRun_t *run)
+{
+    if (run->wheel != NULL)
+    {
+        timewheel_destroy(run->wheel);
+        run->wheel = NULL;
+    }
+
+    if (run->eventList != NULL)
+    {
+        /* frees the list itself as well */
+        eventList_destroy(run->eventList);
+        run->eventList = NULL;
+    }
+}
+
+/* only the timers that fired are sorted, move them to the front first */
+static void benchCompactLate(BenchRun_t *run)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < run->events; i++)
+    {
+        if (run->args[i].fired)
+        {
+            run->lateNs[count++] = run->lateNs[i];
+        }
+    }
+}
+
+static int benchRun(BenchRun_t *run, BenchResult_t *result)
+{
+    memset(result, 0, sizeof(BenchResult_t));
+    run->firedCount = 0;
+    g_run = run;
+    run->args = (BenchArg_t*) calloc(run->events, sizeof(BenchArg_t));
+    run->lateNs = (int64_t*) calloc(run->events, sizeof(int64_t));
+    int missFd = cacheMissOpen();
+    if (run->args == NULL || run->lateNs == NULL || benchStart(run) != 0)
+    {
+        cacheMissClose(missFd);
+        free(run->args);
+        free(run->lateNs);
+        return -1;
+    }
+
+    BenchProducer_t producers[BENCH_MAX_PRODUCERS];
+    pthread_t threads[BENCH_MAX_PRODUCERS];
+    uint32_t producerCount = run->producers < BENCH_MAX_PRODUCERS ? run->producers : BENCH_MAX_PRODUCERS;
+    uint32_t share = run->events / producerCount;
+    int ret = 0;
+
+    uint64_t startNs = nowNs(CLOCK_MONOTONIC);
+    uint64_t startCpuUs = cpuTimeUs();
+    long startFaults = minorFaults();
+
+    for (uint32_t i = 0; i < producerCount; i++)
+    {
+        producers[i].run = run;
+        producers[i].first = i * share;
+        producers[i].count = i == producerCount - 1 ? run->events - i * share : share;
+        if (pthread_create(&threads[i], NULL, benchProducer, &producers[i]) != 0)
+        {
+            producerCount = i;
+            ret = -1;
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; i < producerCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+        ret = producers[i].ret != 0 ? -1 : ret;
+    }
+
+    uint64_t insertNs = nowNs(CLOCK_MONOTONIC) - startNs;
+    result->opsPerSec = (double) run->events * (run->scenario == BENCH_SCENARIO_CHURN ? 2 : 1) * 1e9 / (double) insertNs;
+
+    if (ret == 0 && run->scenario == BENCH_SCENARIO_FIRE && run->engine == BENCH_ENGINE_MANUAL)
+    {
+        /* every timer is due within maxIntervalMs of virtual time */
+        ret = timewheel_advance(run->wheel, (uint64_t) run->maxIntervalMs * 1000 / run->stepUs);
+    }
+    else if (ret == 0 && run->scenario == BENCH_SCENARIO_FIRE)
+    {
+        uint64_t deadlineNs = nowNs(CLOCK_MONOTONIC) + ((uint64_t) run->maxIntervalMs + BENCH_DRAIN_GRACE_MS) * 1000000ULL;
+
+        while (__atomic_load_n(&run->firedCount, __ATOMIC_ACQUIRE) < run->events && nowNs(CLOCK_MONOTONIC) < deadlineNs)
+        {
+            usleep(1000);
+        }
+    }
+
+    uint64_t wallUs = (nowNs(CLOCK_MONOTONIC) - startNs) / 1000;
+    result->drainMs = run->scenario == BENCH_SCENARIO_FIRE ? (double) (wallUs * 1000 - insertNs) / 1e6 : 0.0;
+    result->cpuPct = wallUs > 0 ? (double) (cpuTimeUs() - startCpuUs) * 100.0 / (double) wallUs : 0.0;
+    result->minorFaults = minorFaults() - startFaults;
+    result->rssKb = residentKb();
+    result->cacheMisses = cacheMissClose(missFd);
+    benchStop(run);
+
+    /* the engines are stopped, nothing writes lateNs any more */
+    result->fired = run->firedCount;
+    benchCompactLate(run);
+    qsort(run->lateNs, result->fired, sizeof(int64_t), compareLate);
+    result->p50Us = percentileUs(run->lateNs, result->fired, 50.0);
+    result->p99Us = percentileUs(run->lateNs, result->fired, 99.0);
+    result->p999Us = percentileUs(run->lateNs, result->fired, 99.9);
+
+    free(run->args);
+    free(run->lateNs);
+    run->args = NULL;
+    run->lateNs = NULL;
+
+    return ret;
+}
+
+static void printResult(int json, const char *arch, const BenchRun_t *run, const BenchResult_t *result)
+{
+    const char *scenario = run->scenario == BENCH_SCENARIO_CHURN ? "churn" : "fire";
+
+    if (json)
+    {
+        printf("{\"revision\":\"%s\",\"arch\":\"%s\",\"engine\":\"%s\",\"scenario\":\"%s\",\"events\":%u,"
+                "\"producers\":%u,\"step_us\":%u,\"batch\":%u,\"ops_per_sec\":%.0f,\"fired\":%u,\"p50_us\":%.1f,"
+                "\"p99_us\":%.1f,\"p999_us\":%.1f,\"drain_ms\":%.3f,\"rss_kb\":%ld,\"cache_misses\":%lld,\"cpu_pct\":%.1f,"
+                "\"rt_prio\":%d,\"minor_faults\":%ld}\n",
+                BENCH_REVISION, arch, g_engineNames[run->engine], scenario, run->events, run->producers, run->stepUs, run->batch,
+                result->opsPerSec, result->fired, result->p50Us, result->p99Us, result->p999Us, result->drainMs, result->rssKb,
+                result->cacheMisses, result->cpuPct, run->rtPriority, result->minorFaults);
+    }
+    else
+    {
+        printf("%s,%s,%s,%s,%u,%u,%u,%u,%.0f,%u,%.1f,%.1f,%.1f,%.3f,%ld,%lld,%.1f,%d,%ld\n",
+                BENCH_REVISION, arch, g_engineNames[run->engine], scenario, run->events, run->producers, run->stepUs, run->batch,
+                result->opsPerSec, result->fired, result->p50Us, result->p99Us, result->p999Us, result->drainMs, result->rssKb,
+                result->cacheMisses, result->cpuPct, run->rtPriority, result->minorFaults);
+    }
+    fflush(stdout);
+}
+
+/* comma separated unsigned list, returns the number of values */
+static uint32_t parseList(const char *text, uint32_t *values)
+{
+    uint32_t count = 0;
+    char *copy = strdup(text);
+
+    for (char *token = strtok(copy, ","); token != NULL && count < BENCH_MAX_VALUES; token = strtok(NULL, ","))
+    {
+        values[count++] = (uint32_t) strtoul(token, NULL, 0);
+    }
+    free(copy);
+
+    return count;
+}
+
+static uint32_t parseEngines(const char *text, uint32_t *values)
+{
+    uint32_t count = 0;
+    char *copy = strdup(text);
+
+    for (char *token = strtok(copy, ","); token != NULL && count < BENCH_MAX_VALUES; token = strtok(NULL, ","))
+    {
+        for (uint32_t i = 0; i < BENCH_ENGINE_COUNT; i++)
+        {
+            if (strcmp(token, g_engineNames[i]) == 0)
+            {
+                values[count++] = i;
+            }
+        }
+    }
+    free(copy);
+
+    return count;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-e engines] [-n counts] [-p producers] [-s stepUs] [-b batch] [-i maxIntervalMs] [-l maxListEvents] [-r priority] [-c] [-j]\n"
+            "  -e  wheel,tickless,list,heap,manual (default all)\n"
+            "  -n  timer counts, e.g. 1000,10000,100000,1000000,10000000 (default 1000,10000,100000,1000000)\n"
+            "  -p  producer threads (default 1,4)\n"
+            "  -s  tick sizes in microseconds for the wheels (default 1000)\n"
+            "  -b  timers per timewheel_create_events() call for the wheels, 1 creates them one by one (default 1)\n"
+            "  -i  intervals are spread over one tick .. this many ms (default 1000)\n"
+            "  -l  skip the list engine above this many timers, it scans every timer per wake up (default 100000)\n"
+            "  -r  run the loop threads SCHED_FIFO at this priority, wheels with prefaulted events and mlockall() (default 0, off)\n"
+            "  -c  fire scenario only, no create+cancel churn\n"
+            "  -j  JSON lines instead of CSV\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t engines[BENCH_MAX_VALUES] = { BENCH_ENGINE_WHEEL, BENCH_ENGINE_TICKLESS, BENCH_ENGINE_LIST, BENCH_ENGINE_HEAP,
+            BENCH_ENGINE_MANUAL };
+    uint32_t engineCount = 5;
+    uint32_t counts[BENCH_MAX_VALUES] = { 1000, 10000, 100000, 1000000 };
+    uint32_t countCount = 4;
+    uint32_t producers[BENCH_MAX_VALUES] = { 1, 4 };
+    uint32_t producerCount = 2;
+    uint32_t steps[BENCH_MAX_VALUES] = { 1000 };
+    uint32_t stepCount = 1;
+    uint32_t batches[BENCH_MAX_VALUES] = { 1 };
+    uint32_t batchCount = 1;
+    uint32_t maxIntervalMs = 1000;
+    uint32_t maxListEvents = 100000;
+    int rtPriority = 0;
+    int churn = 1;
+    int json = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:n:p:s:b:i:l:r:cjh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'e':
+                engineCount = parseEngines(optarg, engines);
+                break;
+            case 'n':
+                countCount = parseList(optarg, counts);
+                break;
+            case 'p':
+                producerCount = parseList(optarg, producers);
+                break;
+            case 's':
+                stepCount = parseList(optarg, steps);
+                break;
+            case 'b':
+                batchCount = parseList(optarg, batches);
+                break;
+            case 'i':
+                maxIntervalMs = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                maxListEvents = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                rtPriority = (int) strtol(optarg, NULL, 0);
+                break;
+            case 'c':
+                churn = 0;
+                break;
+            case 'j':
+                json = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : -1;
+        }
+    }
+
+    struct utsname name;
+    const char *arch = uname(&name) == 0 ? name.machine : "unknown";
+
+    if (!json)
+    {
+        printf("revision,arch,engine,scenario,events,producers,step_us,batch,ops_per_sec,fired,p50_us,p99_us,p999_us,drain_ms,rss_kb,cache_misses,cpu_pct,rt_prio,minor_faults\n");
+    }
+
+    int failed = 0;
+    for (uint32_t e = 0; e < engineCount; e++)
+    {
+        int isWheel = benchIsWheel((BenchEngine_t) engines[e]);
+
+        /* every tick size with every batch size, the event lists run in milliseconds one by one */
+        for (uint32_t s = 0; s < (isWheel ? stepCount * batchCount : 1); s++)
+        {
+            for (uint32_t n = 0; n < countCount; n++)
+            {
+                if (engines[e] == BENCH_ENGINE_LIST && counts[n] > maxListEvents)
+                {
+                    continue;
+                }
+
+                for (uint32_t p = 0; p < producerCount; p++)
+                {
+                    for (int scenario = BENCH_SCENARIO_FIRE; scenario <= (churn ? BENCH_SCENARIO_CHURN : BENCH_SCENARIO_FIRE); scenario++)
+                    {
+                        BenchRun_t run;
+                        BenchResult_t result;
+
+                        memset(&run, 0, sizeof(BenchRun_t));
+                        run.engine = (BenchEngine_t) engines[e];
+                        run.scenario = (BenchScenario_t) scenario;
+                        run.events = counts[n];
+                        run.producers = producers[p] == 0 ? 1 : producers[p];
+                        run.stepUs = isWheel ? steps[s / batchCount] : 1000;
+                        run.batch = isWheel && batches[s % batchCount] > 1 ? batches[s % batchCount] : 1;
+                        run.maxIntervalMs = maxIntervalMs;
+                        run.rtPriority = rtPriority;
+
+                        if (run.events == 0 || run.stepUs == 0 || run.maxIntervalMs * 1000 < run.stepUs)
+                        {
+                            continue;
+                        }
+
+                        fprintf(stderr, "%s %s events=%u producers=%u step_us=%u batch=%u\n", g_engineNames[run.engine],
+                                scenario == BENCH_SCENARIO_CHURN ? "churn" : "fire", run.events, run.producers, run.stepUs, run.batch);
+                        if (benchRun(&run, &result) != 0)
+                        {
+                            fprintf(stderr, "run failed\n");
+                            failed = 1;
+                        }
+                        printResult(json, arch, &run, &result);
+                    }
+                }
+            }
+        }
+    }
+
+    return failed ? -1 : 0;
+}
@@ -27,7 +27,8 @@ void funccc(void *arg)
     uint64_t diff = nowMs > ev->expectTimeMs ? nowMs - ev->expectTimeMs : ev->expectTimeMs - nowMs;
     float error = ((float) diff / (float) ev->interval) * 100.0f;
     DEBUG_TIME_LINE("event[%u] startTime-%llu runCount-%u, expectRunTime-%llu, now-%llu, diff-%llu, interval-%u, error-%.4f%%",
-            ev->id, ev->startTimeMs, ev->runCount, ev->expectTimeMs, nowMs, diff, ev->interval, error);
+            ev->id, (unsigned long long) ev->startTimeMs, ev->runCount, (unsigned long long) ev->expectTimeMs,
+            (unsigned long long) nowMs, (unsigned long long) diff, ev->interval, error);
 }
 
 int main(int argc __attribute__((unused)), char *argv[] __attribute__((unused)))
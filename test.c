@@ -0,0 +1,529 @@
+/*
+ * Regression tests for the timer engines.
+ *
+ * Each test drives a wheel or event list through one scenario that broke
+ * before and checks the outcome. Manual wheels are used wherever time
+ * matters, so the results do not depend on the speed of the machine.
+ * Prints one line per test and exits non-zero if any check failed.
+ */
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "timewheel.h"
+
+#define CHECK(cond)     do { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            g_failed++; \
+        } \
+    } while (0)
+
+static int g_failed;
+
+static void countFired(void *arg)
+{
+    __atomic_fetch_add((uint32_t*) arg, 1, __ATOMIC_RELAXED);
+}
+
+static TimeWheel_t* createManualWheel(uint32_t steps, uint32_t maxMin)
+{
+    TimeWheelConfig_t config;
+
+    timewheel_config_default(&config, steps, maxMin);
+    config.mode = TIMEWHEEL_MODE_MANUAL;
+    return timewheel_create_ex(&config);
+}
+
+static TimeWheel_t* createWorkerWheel(TimeWheelMode_t mode, uint32_t workerCount)
+{
+    TimeWheelConfig_t config;
+
+    timewheel_config_default(&config, 1, 1);
+    config.mode = mode;
+    config.workerCount = workerCount;
+    return timewheel_create_ex(&config);
+}
+
+/* one-shot events spread over the first count milliseconds */
+static void addSpreadEvents(TimeWheel_t *wheel, uint32_t count, uint32_t *fired)
+{
+    TimeWheelEventSpec_t spec;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        timewheel_event_spec_default(&spec, i + 1, countFired, fired);
+        spec.repeat = 1;
+        CHECK(timewheel_create_event_ex(wheel, &spec, NULL) == 0);
+    }
+}
+
+static uint32_t countBits(const SlotBitmap_t *bitmap)
+{
+    uint32_t bits = 0;
+
+    for (uint32_t i = 0; i < (bitmap->size + 63) / 64; i++)
+    {
+        bits += (uint32_t) __builtin_popcountll(bitmap->words[i]);
+    }
+
+    return bits;
+}
+
+/* events go to the millisecond, second and minute level or the overflow heap, and each fires on its own tick */
+static void testSlotPlacement(void)
+{
+    static const uint32_t dueMs[] = { 7, 2500, 61234, 125000, 400000 };
+    TimeWheel_t *wheel = createManualWheel(1, 3);
+    TimeWheelEventSpec_t spec;
+    uint32_t fired[ARRAY_SIZE(dueMs)] = { 0 };
+    uint64_t now = 0;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(dueMs); i++)
+    {
+        timewheel_event_spec_default(&spec, dueMs[i], countFired, &fired[i]);
+        spec.repeat = 1;
+        CHECK(timewheel_create_event_ex(wheel, &spec, NULL) == 0);
+    }
+
+    /* the producers' inbox is drained on the next advance, even one of zero ticks */
+    timewheel_advance(wheel, 0);
+    CHECK(countBits(&wheel->levelBitmap[0]) == 1);
+    CHECK(countBits(&wheel->levelBitmap[1]) == 1);
+    CHECK(countBits(&wheel->levelBitmap[2]) == 2);
+    CHECK(wheel->overflow.size == 1);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(dueMs); i++)
+    {
+        timewheel_advance(wheel, dueMs[i] - 1 - now);
+        CHECK(fired[i] == 0);
+        timewheel_advance(wheel, 1);
+        CHECK(fired[i] == 1);
+        now = dueMs[i];
+    }
+
+    timewheel_advance(wheel, 400000);
+    for (uint32_t i = 0; i < ARRAY_SIZE(dueMs); i++)
+    {
+        CHECK(fired[i] == 1);
+    }
+    CHECK(wheel->overflow.size == 0);
+    timewheel_destroy(wheel);
+}
+
+/* a handle stops matching once its event finished or was cancelled, even after the event is reused */
+static void testStaleHandle(void)
+{
+    TimeWheel_t *wheel = createManualWheel(1, 1);
+    TimeWheelEventSpec_t spec;
+    TimeWheelHandle_t once;
+    TimeWheelHandle_t cancelled;
+    TimeWheelHandle_t reused;
+    uint32_t fired = 0;
+    uint32_t reusedFired = 0;
+
+    timewheel_event_spec_default(&spec, 10, countFired, &fired);
+    spec.repeat = 1;
+    CHECK(timewheel_create_event_ex(wheel, &spec, &once) == 0);
+    timewheel_advance(wheel, 10);
+    CHECK(fired == 1);
+    CHECK(timewheel_cancel_event(wheel, once) != 0);
+    CHECK(timewheel_modify_event(wheel, once, 20) != 0);
+    CHECK(timewheel_touch(wheel, once) != 0);
+
+    timewheel_event_spec_default(&spec, 10, countFired, &fired);
+    CHECK(timewheel_create_event_ex(wheel, &spec, &cancelled) == 0);
+    CHECK(timewheel_cancel_event(wheel, cancelled) == 0);
+    CHECK(timewheel_cancel_event(wheel, cancelled) != 0);
+    CHECK(timewheel_touch(wheel, cancelled) != 0);
+
+    /* freed once the inbox is drained, then handed out again under a new generation */
+    timewheel_advance(wheel, 0);
+    timewheel_event_spec_default(&spec, 10, countFired, &reusedFired);
+    spec.repeat = 1;
+    CHECK(timewheel_create_event_ex(wheel, &spec, &reused) == 0);
+    CHECK((uint32_t) reused == (uint32_t) cancelled && reused != cancelled);
+    CHECK(timewheel_cancel_event(wheel, cancelled) != 0);
+    CHECK(timewheel_modify_event(wheel, cancelled, 20) != 0);
+    CHECK(timewheel_touch(wheel, cancelled) != 0);
+
+    timewheel_advance(wheel, 20);
+    CHECK(fired == 1);
+    CHECK(reusedFired == 1);
+    timewheel_destroy(wheel);
+}
+
+typedef struct OverrunRuns {
+        uint32_t runs;
+        uint32_t missed; /* summed timewheel_missed_runs() */
+} OverrunRuns_t;
+
+static void countOverrun(void *arg)
+{
+    OverrunRuns_t *runs = (OverrunRuns_t*) arg;
+
+    runs->runs++;
+    runs->missed += timewheel_missed_runs();
+}
+
+/* a 10ms event stalled for 1005 ticks, then followed for 10 more, under one policy */
+static void runOverrun(TimeWheelOverrun_t overrun, OverrunRuns_t *runs, uint32_t *runsAt1010, TimeWheelStats_t *stats)
+{
+    TimeWheel_t *wheel = createManualWheel(1, 1);
+    TimeWheelEventSpec_t spec;
+
+    memset(runs, 0, sizeof(*runs));
+    timewheel_event_spec_default(&spec, 10, countOverrun, runs);
+    spec.overrun = overrun;
+    CHECK(timewheel_create_event_ex(wheel, &spec, NULL) == 0);
+
+    timewheel_advance(wheel, 1005);
+    timewheel_get_stats(wheel, stats);
+    timewheel_advance(wheel, 5);
+    *runsAt1010 = runs->runs;
+    timewheel_advance(wheel, 5);
+    timewheel_destroy(wheel);
+}
+
+/* one advance over 100 periods: FIRE_ALL catches up, FIRE_ONCE and SKIP run once and report 99 missed */
+static void testOverrunPolicies(void)
+{
+    OverrunRuns_t runs;
+    TimeWheelStats_t stats;
+    uint32_t runsAt1010;
+
+    runOverrun(TIMEWHEEL_OVERRUN_FIRE_ALL, &runs, &runsAt1010, &stats);
+    CHECK(stats.fired == 100 && stats.missed == 0);
+    CHECK(runsAt1010 == 101 && runs.runs == 101 && runs.missed == 0);
+
+    /* the next period counts from the late run at 1005 */
+    runOverrun(TIMEWHEEL_OVERRUN_FIRE_ONCE, &runs, &runsAt1010, &stats);
+    CHECK(stats.fired == 1 && stats.missed == 99);
+    CHECK(runsAt1010 == 1 && runs.runs == 2 && runs.missed == 99);
+
+    /* the next run stays on the original 10ms grid */
+    runOverrun(TIMEWHEEL_OVERRUN_SKIP, &runs, &runsAt1010, &stats);
+    CHECK(stats.fired == 1 && stats.missed == 99);
+    CHECK(runsAt1010 == 2 && runs.runs == 2 && runs.missed == 99);
+}
+
+/* a touched event whose slack let it be visited after its touched deadline still fires */
+static void testSlackTouch(void)
+{
+    TimeWheel_t *wheel = createManualWheel(1, 1);
+    TimeWheelEventSpec_t spec;
+    TimeWheelHandle_t handle;
+    TimeWheelStats_t stats;
+    uint32_t fired = 0;
+
+    timewheel_event_spec_default(&spec, 10, countFired, &fired);
+    spec.slackUs = 500000;
+    spec.repeat = 1;
+    CHECK(timewheel_create_event_ex(wheel, &spec, &handle) == 0);
+    timewheel_advance(wheel, 1);
+    CHECK(timewheel_touch(wheel, handle) == 0);
+    timewheel_advance(wheel, 3000);
+
+    timewheel_get_stats(wheel, &stats);
+    CHECK(fired == 1);
+    CHECK(stats.pending == 0);
+    timewheel_destroy(wheel);
+}
+
+/* arg of a list callback that cancels and adds events of its own list */
+typedef struct ListReentry {
+        arg_t base; /* first, the list engine reads its run time from it */
+        EventList_t *eventList;
+        Event_t *self;
+        Event_t *victim;
+        arg_t victimArg;
+        arg_t addedArg;
+} ListReentry_t;
+
+static void countRuns(void *arg)
+{
+    __atomic_fetch_add(&((arg_t*) arg)->runCount, 1, __ATOMIC_RELAXED);
+}
+
+static void initListArg(arg_t *arg, uint32_t intervalMs)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    arg->interval = intervalMs;
+    arg->startTimeMs = get_ms_by_timesp(&now);
+    arg->nextTimemMs = arg->startTimeMs + intervalMs;
+}
+
+static void reenterList(void *arg)
+{
+    ListReentry_t *reentry = (ListReentry_t*) arg;
+
+    reentry->base.runCount++;
+    CHECK(eventList_cancelEvent(reentry->eventList, reentry->victim) == 0);
+    CHECK(eventList_cancelEvent(reentry->eventList, reentry->victim) != 0);
+    initListArg(&reentry->addedArg, 5);
+    CHECK(eventList_addEvent(reentry->eventList, 5, countRuns, &reentry->addedArg) == 0);
+    CHECK(eventList_setOverrun(reentry->eventList, reentry->self, TIMEWHEEL_OVERRUN_FIRE_ONCE) == 0);
+    CHECK(eventList_cancelEvent(reentry->eventList, reentry->self) == 0);
+}
+
+/* a callback can change its own list, including cancelling itself, without deadlocking the loop */
+static void runListReentry(EventListEngine_t engine)
+{
+    EventList_t *eventList = (EventList_t*) calloc(1, sizeof(EventList_t));
+    ListReentry_t reentry;
+
+    memset(&reentry, 0, sizeof(reentry));
+    CHECK(eventList != NULL && eventListInitEx(eventList, engine) == 0);
+    reentry.eventList = eventList;
+
+    initListArg(&reentry.victimArg, 50);
+    CHECK(eventList_addEventEx(eventList, 50, countRuns, &reentry.victimArg, &reentry.victim) == 0);
+    initListArg(&reentry.base, 10);
+    CHECK(eventList_addEventEx(eventList, 10, reenterList, &reentry, &reentry.self) == 0);
+
+    usleep(100000);
+    eventList_destroy(eventList);
+
+    CHECK(reentry.base.runCount == 1);
+    CHECK(reentry.victimArg.runCount == 0);
+    CHECK(reentry.addedArg.runCount > 0);
+}
+
+static void testListReentry(void)
+{
+    runListReentry(EVENTLIST_ENGINE_LIST);
+}
+
+static void testHeapReentry(void)
+{
+    runListReentry(EVENTLIST_ENGINE_HEAP);
+}
+
+/* cancelling an event twice fails the second time and leaves the other events alone */
+static void testHeapDoubleCancel(void)
+{
+    EventList_t *eventList = (EventList_t*) calloc(1, sizeof(EventList_t));
+    Event_t *events[3];
+    uint32_t fired = 0;
+
+    CHECK(eventList != NULL && eventListInitEx(eventList, EVENTLIST_ENGINE_HEAP) == 0);
+    for (uint32_t i = 0; i < ARRAY_SIZE(events); i++)
+    {
+        CHECK(eventList_addEventEx(eventList, 1000 + i * 1000, countFired, &fired, &events[i]) == 0);
+    }
+
+    CHECK(eventList_cancelEvent(eventList, events[0]) == 0);
+    CHECK(eventList_cancelEvent(eventList, events[0]) != 0);
+    CHECK(eventList->heap->size == 2);
+    CHECK(eventList_cancelEvent(eventList, events[2]) == 0);
+    CHECK(eventList_cancelEvent(eventList, events[1]) == 0);
+    CHECK(eventList->heap->size == 0);
+    CHECK(eventList_cancelEvent(eventList, events[1]) != 0);
+
+    eventList_destroy(eventList);
+    CHECK(fired == 0);
+}
+
+/* next matching second after afterSec, UINT64_MAX if the schedule never matches again */
+static uint64_t cronNext(const char *expr, uint8_t flags, uint64_t afterSec)
+{
+    TimeWheelCron_t cron;
+    uint64_t nextUs = 0;
+
+    CHECK(timewheel_cron_parse(&cron, expr) == 0);
+    cron.flags |= flags;
+    if (timewheel_cron_next(&cron, afterSec * 1000000ULL, &nextUs) != 0)
+    {
+        return UINT64_MAX;
+    }
+
+    return nextUs / 1000000ULL;
+}
+
+/* parsing of the six and five field forms, and UTC schedules over day, weekday and leap-year rules */
+static void testCronSchedules(void)
+{
+    TimeWheelCron_t cron;
+
+    CHECK(timewheel_cron_parse(&cron, "*/15 * * * *") == 0);
+    CHECK(cron.seconds == 1 && cron.minutes == ((1ULL << 0) | (1ULL << 15) | (1ULL << 30) | (1ULL << 45)));
+    CHECK(timewheel_cron_parse(&cron, "61 * * * * *") != 0);
+    CHECK(timewheel_cron_parse(&cron, "0 0 24 * * *") != 0);
+    CHECK(timewheel_cron_parse(&cron, "0 0 0 0 * *") != 0);
+    CHECK(timewheel_cron_parse(&cron, "* * *") != 0);
+    CHECK(timewheel_cron_parse(&cron, "") != 0);
+
+    /* 2025-01-01 00:00:00 UTC, a Wednesday; strictly after, so a matching start is skipped */
+    CHECK(cronNext("*/15 * * * *", TIMEWHEEL_CRON_UTC, 1735689600) == 1735690500);
+    CHECK(cronNext("*/15 * * * *", TIMEWHEEL_CRON_UTC, 1735690500) == 1735691400);
+    CHECK(cronNext("* * * * * *", TIMEWHEEL_CRON_UTC, 1735689600) == 1735689601);
+    /* Saturday 10:00 to Monday 09:30 */
+    CHECK(cronNext("0 30 9 * * 1-5", TIMEWHEEL_CRON_UTC, 1735984800) == 1736155800);
+    /* day of month or day of week, whichever comes first: Friday the 3rd */
+    CHECK(cronNext("0 0 0 13 * 5", TIMEWHEEL_CRON_UTC, 1735689600) == 1735862400);
+    /* 7 is Sunday as well */
+    CHECK(cronNext("0 0 0 * * 7", TIMEWHEEL_CRON_UTC, 1735689600) == 1736035200);
+    CHECK(cronNext("0 0 0 29 2 *", TIMEWHEEL_CRON_UTC, 1735689600) == 1835395200);
+    CHECK(cronNext("0 0 0 30 2 *", TIMEWHEEL_CRON_UTC, 1735689600) == UINT64_MAX);
+}
+
+/* local cron times stay strictly after the start and in order through the repeated hour of the DST fall-back */
+static void testCronFallBack(void)
+{
+    const char *oldTz = getenv("TZ");
+    char *savedTz = oldTz != NULL ? strdup(oldTz) : NULL;
+
+    setenv("TZ", "America/New_York", 1);
+    tzset();
+
+    /* 2025-11-02 01:40:00 EST, the second 01:40 of the night */
+    CHECK(cronNext("0 * * * * *", 0, 1762065600) == 1762065660);
+    /* 01:59:30 EDT, the next full minute is 01:00:00 EST */
+    CHECK(cronNext("0 * * * * *", 0, 1762063170) == 1762063200);
+    /* 01:40:00 EST, the 01:00 hour already passed twice */
+    CHECK(cronNext("0 0 1 * * *", 0, 1762065600) == 1762149600);
+    /* January to 2025-07-01 00:30 EDT, the month jump crosses into DST */
+    CHECK(cronNext("0 30 0 1 7 *", 0, 1736942400) == 1751344200);
+
+    if (savedTz != NULL)
+    {
+        setenv("TZ", savedTz, 1);
+        free(savedTz);
+    }
+    else
+    {
+        unsetenv("TZ");
+    }
+    tzset();
+}
+
+#define DRIVER_EVENTS   2000
+
+static void* advanceDriver(void *arg)
+{
+    for (uint32_t i = 0; i < DRIVER_EVENTS + 500; i++)
+    {
+        timewheel_advance((TimeWheel_t*) arg, 1);
+    }
+
+    return NULL;
+}
+
+/* two threads advancing one manual wheel hand every callback to the workers exactly once */
+static void testManualTwoDrivers(void)
+{
+    TimeWheel_t *wheel = createWorkerWheel(TIMEWHEEL_MODE_MANUAL, 2);
+    pthread_t drivers[2];
+    uint32_t fired = 0;
+
+    addSpreadEvents(wheel, DRIVER_EVENTS, &fired);
+    for (uint32_t i = 0; i < ARRAY_SIZE(drivers); i++)
+    {
+        CHECK(pthread_create(&drivers[i], NULL, advanceDriver, wheel) == 0);
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE(drivers); i++)
+    {
+        pthread_join(drivers[i], NULL);
+    }
+
+    /* destroying the wheel waits for the jobs still queued on the workers */
+    timewheel_destroy(wheel);
+    CHECK(fired == DRIVER_EVENTS);
+}
+
+#define POLLER_EVENTS   300
+
+typedef struct Poller {
+        TimeWheel_t *wheel;
+        uint32_t stop;
+} Poller_t;
+
+static void* pollDriver(void *arg)
+{
+    Poller_t *poller = (Poller_t*) arg;
+    struct pollfd pfd = { timewheel_get_fd(poller->wheel), POLLIN, 0 };
+
+    while (!__atomic_load_n(&poller->stop, __ATOMIC_ACQUIRE))
+    {
+        if (poll(&pfd, 1, 10) > 0)
+        {
+            timewheel_process_expired(poller->wheel);
+        }
+    }
+
+    return NULL;
+}
+
+/* two I/O threads polling one timerfd wheel hand every callback to the workers exactly once */
+static void testTimerfdTwoPollers(void)
+{
+    Poller_t poller = { createWorkerWheel(TIMEWHEEL_MODE_TIMERFD, 2), 0 };
+    pthread_t drivers[2];
+    TimeWheelStats_t stats;
+    uint32_t fired = 0;
+
+    addSpreadEvents(poller.wheel, POLLER_EVENTS, &fired);
+    for (uint32_t i = 0; i < ARRAY_SIZE(drivers); i++)
+    {
+        CHECK(pthread_create(&drivers[i], NULL, pollDriver, &poller) == 0);
+    }
+
+    for (uint32_t i = 0; i < 300; i++)
+    {
+        timewheel_get_stats(poller.wheel, &stats);
+        if (stats.pending == 0)
+        {
+            break;
+        }
+        usleep(10000);
+    }
+
+    __atomic_store_n(&poller.stop, 1, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < ARRAY_SIZE(drivers); i++)
+    {
+        pthread_join(drivers[i], NULL);
+    }
+
+    timewheel_destroy(poller.wheel);
+    CHECK(stats.pending == 0);
+    CHECK(fired == POLLER_EVENTS);
+}
+
+typedef struct Test {
+        const char *name;
+        void (*run)(void);
+} Test_t;
+
+static const Test_t g_tests[] = {
+        { "slot_placement", testSlotPlacement },
+        { "stale_handle", testStaleHandle },
+        { "slack_touch", testSlackTouch },
+        { "overrun_policies", testOverrunPolicies },
+        { "list_reentry", testListReentry },
+        { "heap_reentry", testHeapReentry },
+        { "heap_double_cancel", testHeapDoubleCancel },
+        { "cron_schedules", testCronSchedules },
+        { "cron_fall_back", testCronFallBack },
+        { "manual_two_drivers", testManualTwoDrivers },
+        { "timerfd_two_pollers", testTimerfdTwoPollers },
+};
+
+int main(void)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(g_tests); i++)
+    {
+        int failedBefore = g_failed;
+
+        g_tests[i].run();
+        printf("%-24s %s\n", g_tests[i].name, g_failed == failedBefore ? "ok" : "FAILED");
+    }
+
+    return g_failed == 0 ? 0 : 1;
+}
@@ -1,7 +1,13 @@
+#define _GNU_SOURCE /* sched_getcpu, pthread_attr_setaffinity_np */
 #include "timewheel.h"
+#include <sched.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <errno.h>
 #include <stdarg.h>
@@ -62,6 +68,571 @@ void debugBufFormat2fp(FILE *fp, const char *file, const char *func, int line, c
     }
 }
 
+/* ==================== Asynchronous Log ==================== */
+
+#define LOG_LINE_MAX            1024    /* one formatted line, longer ones are cut */
+#define LOG_OUT_SIZE            (64 * 1024)
+#define LOG_IDLE_NS             10000000 /* log thread sleep when all rings are empty */
+#define LOG_SPEC_MAX            32
+
+typedef enum LogArgType {
+        LOG_ARG_NONE = 0, /* %% */
+        LOG_ARG_INT,
+        LOG_ARG_LONG,
+        LOG_ARG_LLONG,
+        LOG_ARG_SIZE,
+        LOG_ARG_INTMAX,
+        LOG_ARG_DOUBLE,
+        LOG_ARG_STRING,
+        LOG_ARG_POINTER,
+        LOG_ARG_UNSUPPORTED,
+} LogArgType_t;
+
+static struct {
+        TimeWheelLogRing_t *rings; /* push only, rings are reused but never freed */
+        pthread_mutex_t drainMutex; /* one drainer at a time: the log thread or timewheel_log_flush() */
+        pthread_key_t ringKey;
+        int fd;
+        int64_t realtimeOffsetNs; /* CLOCK_REALTIME minus CLOCK_MONOTONIC at start */
+        time_t stampSec; /* second the cached stamp was formatted for */
+        char stamp[24];
+        char out[LOG_OUT_SIZE];
+} g_log = { .drainMutex = PTHREAD_MUTEX_INITIALIZER, .fd = STDOUT_FILENO, .stampSec = -1 };
+
+static pthread_once_t g_logOnce = PTHREAD_ONCE_INIT;
+static __thread TimeWheelLogRing_t *t_logRing = NULL;
+
+/* p points at a '%', returns the character after the conversion */
+static const char* logParseSpec(const char *p, LogArgType_t *type)
+{
+    const char *start = p;
+    int longs = 0;
+    int sized = 0;
+    int intmax = 0;
+
+    p++;
+    if (*p == '%')
+    {
+        *type = LOG_ARG_NONE;
+        return p + 1;
+    }
+
+    p += strspn(p, "-+ #0");
+    p += strspn(p, "0123456789");
+    if (*p == '.')
+    {
+        p++;
+        p += strspn(p, "0123456789");
+    }
+
+    for (;; p++)
+    {
+        if (*p == 'l')
+        {
+            longs++;
+        }
+        else if (*p == 'z' || *p == 't')
+        {
+            sized = 1;
+        }
+        else if (*p == 'j')
+        {
+            intmax = 1;
+        }
+        else if (*p != 'h')
+        {
+            break;
+        }
+    }
+
+    switch (*p)
+    {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            *type = intmax ? LOG_ARG_INTMAX : sized ? LOG_ARG_SIZE :
+                    longs >= 2 ? LOG_ARG_LLONG : longs == 1 ? LOG_ARG_LONG : LOG_ARG_INT;
+            break;
+        case 'c':
+            *type = longs == 0 ? LOG_ARG_INT : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            *type = LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            *type = longs == 0 ? LOG_ARG_STRING : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'p':
+            *type = LOG_ARG_POINTER;
+            break;
+        default:
+            /* '*' widths, long double, %n and anything unknown */
+            *type = LOG_ARG_UNSUPPORTED;
+            return p;
+    }
+
+    if (p + 1 - start >= LOG_SPEC_MAX)
+    {
+        *type = LOG_ARG_UNSUPPORTED;
+    }
+
+    return p + 1;
+}
+
+/* keep the arguments raw, strings are copied because the caller's buffer may be gone by the time they are printed */
+static int logCapture(TimeWheelLogRecord_t *record, const char *fmt, va_list ap)
+{
+    uint32_t count = 0;
+    LogArgType_t type;
+
+    for (const char *p = strchr(fmt, '%'); p != NULL; p = strchr(p, '%'))
+    {
+        p = logParseSpec(p, &type);
+        if (type == LOG_ARG_NONE)
+        {
+            continue;
+        }
+
+        if (type == LOG_ARG_UNSUPPORTED || count == TIMEWHEEL_LOG_MAX_ARGS)
+        {
+            return -1;
+        }
+
+        switch (type)
+        {
+            case LOG_ARG_INT:
+                record->args[count] = (uint64_t) va_arg(ap, int);
+                break;
+            case LOG_ARG_LONG:
+                record->args[count] = (uint64_t) va_arg(ap, long);
+                break;
+            case LOG_ARG_LLONG:
+                record->args[count] = (uint64_t) va_arg(ap, long long);
+                break;
+            case LOG_ARG_SIZE:
+                record->args[count] = (uint64_t) va_arg(ap, size_t);
+                break;
+            case LOG_ARG_INTMAX:
+                record->args[count] = (uint64_t) va_arg(ap, intmax_t);
+                break;
+            case LOG_ARG_DOUBLE:
+            {
+                double value = va_arg(ap, double);
+                memcpy(&record->args[count], &value, sizeof(double));
+                break;
+            }
+            case LOG_ARG_POINTER:
+                record->args[count] = (uint64_t) (uintptr_t) va_arg(ap, void*);
+                break;
+            case LOG_ARG_STRING:
+            {
+                const char *str = va_arg(ap, const char*);
+                size_t len;
+
+                if (str == NULL)
+                {
+                    str = "(null)";
+                }
+                len = strlen(str) + 1;
+                if (record->textLen + len > TIMEWHEEL_LOG_TEXT_SIZE)
+                {
+                    return -1;
+                }
+                memcpy(record->text + record->textLen, str, len);
+                record->args[count] = record->textLen;
+                record->textLen += (uint16_t) len;
+                break;
+            }
+            default:
+                return -1;
+        }
+        count++;
+    }
+
+    return 0;
+}
+
+static void logRingRelease(void *arg)
+{
+    TimeWheelLogRing_t *ring = (TimeWheelLogRing_t*) arg;
+
+    __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+static uint32_t logDrain(void);
+
+static void* logThread(void *arg)
+{
+    (void) arg;
+
+    for (;;)
+    {
+        if (logDrain() == 0)
+        {
+            struct timespec idle = { 0, LOG_IDLE_NS };
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static void logStart(void)
+{
+    struct timespec mono;
+    struct timespec real;
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+    g_log.realtimeOffsetNs = ((int64_t) real.tv_sec - mono.tv_sec) * 1000000000LL + (real.tv_nsec - mono.tv_nsec);
+
+    pthread_key_create(&g_log.ringKey, logRingRelease);
+    atexit(timewheel_log_flush);
+
+    /* without the thread the records are still written by timewheel_log_flush() */
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&thread, &attr, logThread, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+static TimeWheelLogRing_t* logThreadRing(void)
+{
+    TimeWheelLogRing_t *ring;
+
+    if (t_logRing != NULL)
+    {
+        return t_logRing;
+    }
+
+    pthread_once(&g_logOnce, logStart);
+
+    /* take over the ring of a thread that exited */
+    for (ring = __atomic_load_n(&g_log.rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+    {
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&ring->owned, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+
+    if (ring == NULL)
+    {
+        void *mem = NULL;
+
+        if (posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(TimeWheelLogRing_t)) != 0)
+        {
+            return NULL;
+        }
+        ring = (TimeWheelLogRing_t*) mem;
+        memset(ring, 0, sizeof(TimeWheelLogRing_t));
+        ring->owned = 1;
+        ring->next = __atomic_load_n(&g_log.rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&g_log.rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+        }
+    }
+
+    pthread_setspecific(g_log.ringKey, ring);
+    t_logRing = ring;
+
+    return ring;
+}
+
+/*
+ * Hot path of every log call: no lock, no allocation once the thread has its
+ * ring and no system call besides the vDSO clock read. Formatting, the local
+ * time stamp and the write happen on the log thread.
+ */
+void timewheel_log(int level, const char *file, const char *func, int line, const void *buf, int len,
+        const char *fmt, ...)
+{
+    TimeWheelLogRing_t *ring = logThreadRing();
+    TimeWheelLogRecord_t *record;
+    struct timespec now;
+    va_list ap;
+    va_list copy;
+    uint32_t tail;
+
+    if (ring == NULL || fmt == NULL)
+    {
+        return;
+    }
+
+    tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= TIMEWHEEL_LOG_RING_SIZE)
+    {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    record = &ring->records[tail & (TIMEWHEEL_LOG_RING_SIZE - 1)];
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    record->timeNs = (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+    record->file = file;
+    record->func = func;
+    record->fmt = fmt;
+    record->line = line;
+    record->level = (uint8_t) level;
+    record->formatted = 0;
+    record->textLen = 0;
+
+    va_start(ap, fmt);
+    va_copy(copy, ap);
+    if (logCapture(record, fmt, copy) != 0)
+    {
+        int n = vsnprintf(record->text, TIMEWHEEL_LOG_TEXT_SIZE, fmt, ap);
+
+        record->formatted = 1;
+        record->textLen = (uint16_t) (n < 0 ? 0 : n >= TIMEWHEEL_LOG_TEXT_SIZE ? TIMEWHEEL_LOG_TEXT_SIZE : n + 1);
+    }
+    va_end(copy);
+    va_end(ap);
+
+    record->hexTotal = buf != NULL && len > 0 ? (uint32_t) len : 0;
+    record->hexOffset = record->textLen;
+    record->hexLen = (uint16_t) (record->hexTotal < (uint32_t) (TIMEWHEEL_LOG_TEXT_SIZE - record->textLen) ?
+            record->hexTotal : (uint32_t) (TIMEWHEEL_LOG_TEXT_SIZE - record->textLen));
+    if (record->hexLen > 0)
+    {
+        memcpy(record->text + record->hexOffset, buf, record->hexLen);
+    }
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static size_t logAppend(size_t pos, size_t size, int n)
+{
+    if (n < 0)
+    {
+        return pos;
+    }
+
+    return pos + (size_t) n >= size ? size - 1 : pos + (size_t) n;
+}
+
+/* one line with the same layout as debugBufFormat2fp() */
+static size_t logFormatRecord(const TimeWheelLogRecord_t *record, char *out, size_t size)
+{
+    uint64_t realNs = record->timeNs + (uint64_t) g_log.realtimeOffsetNs;
+    time_t sec = (time_t) (realNs / 1000000000ULL);
+    const char *file = strrchr(record->file, '/');
+    size_t pos = 0;
+
+    if (sec != g_log.stampSec)
+    {
+        struct tm timeinfo;
+
+        localtime_r(&sec, &timeinfo);
+        strftime(g_log.stamp, sizeof(g_log.stamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+        g_log.stampSec = sec;
+    }
+
+    pos = logAppend(pos, size, snprintf(out, size, "[%s.%03u][%s][%s()][%d]: ", g_log.stamp,
+            (uint32_t) (realNs / 1000000ULL % 1000ULL), file != NULL ? file + 1 : record->file, record->func,
+            record->line));
+
+    if (record->formatted)
+    {
+        pos = logAppend(pos, size, snprintf(out + pos, size - pos, "%s", record->text));
+    }
+    else
+    {
+        const char *p = record->fmt;
+        uint32_t count = 0;
+
+        while (*p != '\0' && pos < size - 1)
+        {
+            const char *spec = strchr(p, '%');
+            char specBuf[LOG_SPEC_MAX];
+            LogArgType_t type;
+            uint64_t arg;
+            size_t literal = spec == NULL ? strlen(p) : (size_t) (spec - p);
+
+            if (literal > size - 1 - pos)
+            {
+                literal = size - 1 - pos;
+            }
+            memcpy(out + pos, p, literal);
+            pos += literal;
+            if (spec == NULL || pos >= size - 1)
+            {
+                break;
+            }
+
+            p = logParseSpec(spec, &type);
+            memcpy(specBuf, spec, (size_t) (p - spec));
+            specBuf[p - spec] = '\0';
+            arg = type == LOG_ARG_NONE ? 0 : record->args[count++];
+
+            switch (type)
+            {
+                case LOG_ARG_NONE:
+                    out[pos++] = '%'; /* pos < size - 1 here, the newline still fits */
+                    break;
+                case LOG_ARG_INT:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, (int) arg));
+                    break;
+                case LOG_ARG_LONG:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, (long) arg));
+                    break;
+                case LOG_ARG_LLONG:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, (long long) arg));
+                    break;
+                case LOG_ARG_SIZE:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, (size_t) arg));
+                    break;
+                case LOG_ARG_INTMAX:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, (intmax_t) arg));
+                    break;
+                case LOG_ARG_DOUBLE:
+                {
+                    double value;
+                    memcpy(&value, &arg, sizeof(double));
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, value));
+                    break;
+                }
+                case LOG_ARG_STRING:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, record->text + arg));
+                    break;
+                case LOG_ARG_POINTER:
+                    pos = logAppend(pos, size, snprintf(out + pos, size - pos, specBuf, (void*) (uintptr_t) arg));
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < record->hexLen && pos + 4 < size; i++)
+    {
+        pos = logAppend(pos, size, snprintf(out + pos, size - pos, "%02X ",
+                (uint8_t) record->text[record->hexOffset + i]));
+    }
+    if (record->hexLen < record->hexTotal)
+    {
+        pos = logAppend(pos, size, snprintf(out + pos, size - pos, "... (%u bytes)", record->hexTotal));
+    }
+
+    out[pos++] = '\n';
+
+    return pos;
+}
+
+static void logWrite(const char *buf, size_t len)
+{
+    int fd = __atomic_load_n(&g_log.fd, __ATOMIC_RELAXED);
+
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        buf += n;
+        len -= (size_t) n;
+    }
+}
+
+static void logReserve(size_t *pos)
+{
+    if (LOG_OUT_SIZE - *pos < LOG_LINE_MAX)
+    {
+        logWrite(g_log.out, *pos);
+        *pos = 0;
+    }
+}
+
+/* format and write everything logged so far in time order across threads, returns the number of records */
+static uint32_t logDrain(void)
+{
+    TimeWheelLogRing_t *rings;
+    uint32_t total = 0;
+    size_t pos = 0;
+
+    pthread_mutex_lock(&g_log.drainMutex);
+    rings = __atomic_load_n(&g_log.rings, __ATOMIC_ACQUIRE);
+    for (TimeWheelLogRing_t *ring = rings; ring != NULL; ring = ring->next)
+    {
+        ring->drainTail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    }
+
+    for (;;)
+    {
+        TimeWheelLogRing_t *oldest = NULL;
+        const TimeWheelLogRecord_t *record = NULL;
+
+        for (TimeWheelLogRing_t *ring = rings; ring != NULL; ring = ring->next)
+        {
+            const TimeWheelLogRecord_t *next = &ring->records[ring->head & (TIMEWHEEL_LOG_RING_SIZE - 1)];
+            if (ring->head != ring->drainTail && (record == NULL || next->timeNs < record->timeNs))
+            {
+                oldest = ring;
+                record = next;
+            }
+        }
+
+        if (oldest == NULL)
+        {
+            break;
+        }
+
+        logReserve(&pos);
+        pos += logFormatRecord(record, g_log.out + pos, LOG_LINE_MAX);
+        __atomic_store_n(&oldest->head, oldest->head + 1, __ATOMIC_RELEASE);
+        total++;
+    }
+
+    for (TimeWheelLogRing_t *ring = rings; ring != NULL; ring = ring->next)
+    {
+        uint64_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+
+        if (dropped > 0)
+        {
+            logReserve(&pos);
+            pos = logAppend(pos, LOG_OUT_SIZE, snprintf(g_log.out + pos, LOG_LINE_MAX,
+                    "[log] %llu messages dropped, the log ring was full\n", (unsigned long long) dropped));
+        }
+    }
+
+    if (pos > 0)
+    {
+        logWrite(g_log.out, pos);
+    }
+    pthread_mutex_unlock(&g_log.drainMutex);
+
+    return total;
+}
+
+void timewheel_log_set_fd(int fd)
+{
+    timewheel_log_flush();
+    __atomic_store_n(&g_log.fd, fd, __ATOMIC_RELAXED);
+}
+
+void timewheel_log_flush(void)
+{
+    logDrain();
+}
+
 /* ==================== Event List Operations ==================== */
 
 static void eventlist_init(EventList_t *list)
@@ -71,7 +642,7 @@ static void eventlist_init(EventList_t *list)
     list->count = 0;
 }
 
-void eventlist_push_back(EventList_t *list, Event_t *event)
+static void eventlist_push_back(EventList_t *list, Event_t *event)
 {
     event->next = NULL;
 
@@ -88,523 +659,4250 @@ void eventlist_push_back(EventList_t *list, Event_t *event)
     list->count++;
 }
 
-void eventlist_clear(EventList_t *list)
-{
-    Event_t *current = list->head;
-    Event_t *next;
+/* ==================== Event Pool ==================== */
 
-    while (current != NULL)
+static uint32_t g_poolCacheSeq = 0;
+static __thread uint32_t t_poolCacheIndex = UINT32_MAX;
+
+/* every producer thread sticks to one cache, assigned round-robin on first use */
+static EventPoolCache_t* eventpool_local_cache(EventPool_t *pool)
+{
+    if (t_poolCacheIndex == UINT32_MAX)
     {
-        next = current->next;
-        free(current);
-        current = next;
+        t_poolCacheIndex = __atomic_fetch_add(&g_poolCacheSeq, 1, __ATOMIC_RELAXED) % EVENT_POOL_CACHE_COUNT;
     }
 
-    list->head = NULL;
-    list->tail = NULL;
-    list->count = 0;
+    return &pool->caches[t_poolCacheIndex];
 }
 
-/* ==================== TimeWheel Internal Functions ==================== */
+/* event states, a handle is only valid while its event is not free or cancelled */
+#define EVENT_STATE_FREE        0
+#define EVENT_STATE_INBOX       1       /* pushed by a producer, not in a slot yet */
+#define EVENT_STATE_SLOT        2       /* linked into eventSlotArray.slots[slotIndex] */
+#define EVENT_STATE_FIRING      3       /* taken off its slot by processEvent() */
+#define EVENT_STATE_CANCELLED   4       /* cancelled or fired its last time, released by whoever owns it next */
+#define EVENT_STATE_OVERFLOW    5       /* in wheel->overflow at heapIndex, a wheel period or more away */
 
-static uint32_t getCurrentMs(TimeWheel_t *wheel, TimePos_t timePos)
+/* internal event flags above the public TIMEWHEEL_EVENT_xxx ones */
+#define EVENT_FLAG_SLACK        0x80    /* cold->slackTicks is set, insertEventToSlot() may place the event late */
+#define EVENT_FLAG_OVERRUN_ONCE 0x40    /* TIMEWHEEL_OVERRUN_FIRE_ONCE */
+#define EVENT_FLAG_OVERRUN_SKIP 0x20    /* TIMEWHEEL_OVERRUN_SKIP */
+#define EVENT_FLAG_WALL         0x10    /* next due time comes from CLOCK_REALTIME, see placeWallEvent() */
+#define EVENT_FLAG_WALL_MOVED   0x08    /* already re-placed by the running syncWallClock() */
+#define EVENT_FLAGS_OVERRUN     (EVENT_FLAG_OVERRUN_ONCE | EVENT_FLAG_OVERRUN_SKIP)
+#define EVENT_FLAGS_INTERNAL    (EVENT_FLAG_SLACK | EVENT_FLAGS_OVERRUN | EVENT_FLAG_WALL | EVENT_FLAG_WALL_MOVED)
+
+static int checkOverrun(TimeWheelOverrun_t overrun)
 {
-    return wheel->steps * timePos.pos_ms + timePos.pos_sec * 1000 + timePos.pos_min * 60 * 1000;
+    if (overrun != TIMEWHEEL_OVERRUN_FIRE_ALL && overrun != TIMEWHEEL_OVERRUN_FIRE_ONCE && overrun != TIMEWHEEL_OVERRUN_SKIP)
+    {
+        ERROR_TIME_LINE("invalid overrun policy: %d", (int) overrun);
+        return -1;
+    }
+
+    return 0;
 }
 
-static uint32_t createEventId(TimeWheel_t *wheel)
+static uint8_t overrunFlags(TimeWheelOverrun_t overrun)
 {
-    return wheel->increaseId++;
+    return overrun == TIMEWHEEL_OVERRUN_FIRE_ONCE ? EVENT_FLAG_OVERRUN_ONCE :
+            overrun == TIMEWHEEL_OVERRUN_SKIP ? EVENT_FLAG_OVERRUN_SKIP : 0;
 }
 
-static void getTriggerTimeFromInterval(TimeWheel_t *wheel, uint32_t interval, TimePos_t *timePos, TimePos_t basePos)
+/* whole periods a run due at dueTick is behind nowTick, the runs an overrun policy folds into this one */
+static uint64_t missedPeriods(uint64_t dueTick, uint64_t intervalTicks, uint64_t nowTick)
 {
-    /* get current time: ms */
-    uint32_t curTime = getCurrentMs(wheel, basePos);
-
-    /* calculate which slot this interval should belong to */
-    uint32_t futureTime = curTime + interval;
-    timePos->pos_min = (futureTime / 1000 / 60) % wheel->thirdLevelCount;
-    timePos->pos_sec = (futureTime % (1000 * 60)) / 1000;
-    timePos->pos_ms = (futureTime % 1000) / wheel->steps;
+    return nowTick > dueTick && intervalTicks != 0 ? (nowTick - dueTick) / intervalTicks : 0;
 }
 
-static void insertEventToSlot(TimeWheel_t *wheel, uint32_t interval, Event_t *event, TimePos_t basePos)
+/* periods the callback running on this thread missed, see timewheel_missed_runs() */
+static __thread uint32_t t_missedRuns = 0;
+
+static uint32_t clampMissed(uint64_t missed)
 {
-    TimePos_t timePos = { 0 };
+    return missed > UINT32_MAX ? UINT32_MAX : (uint32_t) missed;
+}
 
-    /* calculate which slot this event should be set to */
-    getTriggerTimeFromInterval(wheel, interval, &timePos, basePos);
+/* run an event list callback with its missed count visible to timewheel_missed_runs() */
+static void runMissedCallback(Event_t *event, uint64_t missed)
+{
+    t_missedRuns = clampMissed(missed);
+    event->cb(event->arg);
+    t_missedRuns = 0;
+}
 
-    /* determine which level slot to insert */
-    uint32_t slotIndex;
-    if (timePos.pos_min != basePos.pos_min)
+/* must be called with pool->mutex held */
+static int eventpool_grow(EventPool_t *pool)
+{
+    if (pool->chunkCount == EVENT_POOL_MAX_CHUNKS)
     {
-        /* insert to minute slot */
-        slotIndex = wheel->firstLevelCount + wheel->secondLevelCount + timePos.pos_min;
+        return -1;
     }
-    else if (timePos.pos_sec != basePos.pos_sec)
+
+    /* hot events first, their cold halves behind them in the same allocation */
+    size_t chunkBytes = (sizeof(Event_t) + sizeof(EventCold_t)) * EVENT_POOL_CHUNK_SIZE;
+    void *mem = NULL;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, chunkBytes) != 0)
     {
-        /* insert to second slot */
-        slotIndex = wheel->firstLevelCount + timePos.pos_sec;
+        return -1;
     }
-    else if (timePos.pos_ms != basePos.pos_ms)
+
+    Event_t *chunk = (Event_t*) mem;
+    memset(chunk, 0, chunkBytes);
+    for (uint32_t i = 0; i < EVENT_POOL_CHUNK_SIZE; i++)
     {
-        /* insert to millisecond slot */
-        slotIndex = timePos.pos_ms;
+        chunk[i].index = (pool->chunkCount << EVENT_POOL_CHUNK_SHIFT) | i;
+        chunk[i].slotNext = EVENT_INDEX_NONE;
+        chunk[i].slotPrev = EVENT_INDEX_NONE;
+        chunk[i].generation = 1;
+        chunk[i].state = EVENT_STATE_FREE;
+        chunk[i].next = i + 1 < EVENT_POOL_CHUNK_SIZE ? &chunk[i + 1] : pool->freeList;
     }
-    else
+
+    pool->freeList = chunk;
+    pool->freeCount += EVENT_POOL_CHUNK_SIZE;
+    pool->chunks[pool->chunkCount] = chunk;
+    __atomic_store_n(&pool->chunkCount, pool->chunkCount + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/* event behind a pool index, or NULL if that chunk does not exist */
+static Event_t* eventpool_get(EventPool_t *pool, uint32_t index)
+{
+    uint32_t chunk = index >> EVENT_POOL_CHUNK_SHIFT;
+
+    if (chunk >= __atomic_load_n(&pool->chunkCount, __ATOMIC_ACQUIRE))
     {
-        /* should not happen, but handle it */
-        return;
+        return NULL;
     }
 
-    eventlist_push_back(&wheel->eventSlotArray.slots[slotIndex], event);
+    return &pool->chunks[chunk][index & (EVENT_POOL_CHUNK_SIZE - 1)];
 }
 
-static uint32_t processEvent(TimeWheel_t *wheel, EventList_t *eventList, TimePos_t currentPos)
+/* event behind an index the caller got from a linked event, the chunk is known to exist */
+static inline Event_t* eventpool_at(EventPool_t *pool, uint32_t index)
 {
-    Event_t *event = eventList->head;
+    return &pool->chunks[index >> EVENT_POOL_CHUNK_SHIFT][index & (EVENT_POOL_CHUNK_SIZE - 1)];
+}
 
-    while (event != NULL)
-    {
-        /* calculate the current ms */
-        uint32_t currentMs = getCurrentMs(wheel, currentPos);
-        /* calculate last time(ms) this event was processed */
-        uint32_t lastProcessedMs = getCurrentMs(wheel, event->timePos);
+/* cold half of a pool event, stored after the hot halves of its chunk */
+static inline EventCold_t* eventCold(Event_t *event)
+{
+    uint32_t i = event->index & (EVENT_POOL_CHUNK_SIZE - 1);
 
-        /* calculate the distance between now and last time(ms) */
-        uint32_t period = wheel->thirdLevelCount * 60 * 1000;
-        uint32_t distanceMs = (currentMs + period - lastProcessedMs) % period;
+    return (EventCold_t*) (event - i + EVENT_POOL_CHUNK_SIZE) + i;
+}
 
-        Event_t *next = event->next;
+static int eventpool_init(EventPool_t *pool)
+{
+    memset(pool, 0, sizeof(EventPool_t));
 
-        /* if interval == distanceMs, need to process this event */
-        if (event->interval == distanceMs)
-        {
-            /* process event */
-            event->cb(event->arg);
+    pool->chunks = (Event_t**) calloc(EVENT_POOL_MAX_CHUNKS, sizeof(Event_t*));
+    if (pool->chunks == NULL)
+    {
+        return -1;
+    }
 
-            /* create a new event for next trigger */
-            Event_t *newEvent = (Event_t*) malloc(sizeof(Event_t));
-            if (newEvent != NULL)
-            {
-                memcpy(newEvent, event, sizeof(Event_t));
-                newEvent->timePos = currentPos;
-                newEvent->next = NULL;
-                insertEventToSlot(wheel, event->interval, newEvent, currentPos);
-            }
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+    {
+        free(pool->chunks);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < EVENT_POOL_CACHE_COUNT; i++)
+    {
+        pthread_spin_init(&pool->caches[i].lock, PTHREAD_PROCESS_PRIVATE);
+    }
+
+    /* the first chunk up front, so a small wheel never allocates after init */
+    if (eventpool_grow(pool) != 0)
+    {
+        for (uint32_t i = 0; i < EVENT_POOL_CACHE_COUNT; i++)
+        {
+            pthread_spin_destroy(&pool->caches[i].lock);
         }
-        else
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->chunks);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void eventpool_destroy(EventPool_t *pool)
+{
+    for (uint32_t i = 0; i < pool->chunkCount; i++)
+    {
+        free(pool->chunks[i]);
+    }
+    free(pool->chunks);
+
+    for (uint32_t i = 0; i < EVENT_POOL_CACHE_COUNT; i++)
+    {
+        pthread_spin_destroy(&pool->caches[i].lock);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    memset(pool, 0, sizeof(EventPool_t));
+}
+
+static void eventpool_count_use(EventPool_t *pool, uint32_t count)
+{
+    uint32_t inUse = __atomic_add_fetch(&pool->inUse, count, __ATOMIC_RELAXED);
+    uint32_t peak = __atomic_load_n(&pool->peakInUse, __ATOMIC_RELAXED);
+
+    while (inUse > peak &&
+            !__atomic_compare_exchange_n(&pool->peakInUse, &peak, inUse, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static Event_t* eventpool_alloc(EventPool_t *pool)
+{
+    EventPoolCache_t *cache = eventpool_local_cache(pool);
+    Event_t *event = NULL;
+
+    pthread_spin_lock(&cache->lock);
+    if (cache->head == NULL)
+    {
+        /* refill a batch from the shared list, growing the pool if needed */
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->freeList == NULL)
+        {
+            eventpool_grow(pool);
+        }
+
+        for (uint32_t i = 0; i < EVENT_POOL_CACHE_BATCH && pool->freeList != NULL; i++)
+        {
+            Event_t *e = pool->freeList;
+            pool->freeList = e->next;
+            pool->freeCount--;
+            e->next = cache->head;
+            cache->head = e;
+            __atomic_store_n(&cache->count, cache->count + 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if (cache->head != NULL)
+    {
+        event = cache->head;
+        cache->head = event->next;
+        __atomic_store_n(&cache->count, cache->count - 1, __ATOMIC_RELAXED);
+    }
+    pthread_spin_unlock(&cache->lock);
+
+    if (event != NULL)
+    {
+        eventpool_count_use(pool, 1);
+    }
+
+    return event;
+}
+
+/* grow the pool until count events are free, their pages are touched by eventpool_grow() */
+static int eventpool_reserve(EventPool_t *pool, uint32_t count)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->freeCount < count && eventpool_grow(pool) == 0)
+    {
+    }
+    int ret = pool->freeCount >= count ? 0 : -1;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return ret;
+}
+
+/*
+ * Take count events at once, linked through next: whatever the local cache
+ * holds, then the rest from the shared list after growing the pool for all
+ * of it under one lock. NULL, with nothing taken, if the pool is full.
+ */
+static Event_t* eventpool_alloc_batch(EventPool_t *pool, uint32_t count)
+{
+    EventPoolCache_t *cache = eventpool_local_cache(pool);
+    Event_t *chain = NULL;
+    uint32_t taken = 0;
+
+    pthread_spin_lock(&cache->lock);
+    while (taken < count && cache->head != NULL)
+    {
+        Event_t *e = cache->head;
+        cache->head = e->next;
+        __atomic_store_n(&cache->count, cache->count - 1, __ATOMIC_RELAXED);
+        e->next = chain;
+        chain = e;
+        taken++;
+    }
+    pthread_spin_unlock(&cache->lock);
+
+    if (taken < count)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->freeCount < count - taken && eventpool_grow(pool) == 0)
+        {
+        }
+
+        if (pool->freeCount >= count - taken)
         {
-            /* although this event in this position, but it not arriving timing */
-            uint32_t remaining;
-            if (event->interval > distanceMs)
+            for (; taken < count; taken++)
             {
-                remaining = event->interval - distanceMs;
+                Event_t *e = pool->freeList;
+                pool->freeList = e->next;
+                pool->freeCount--;
+                e->next = chain;
+                chain = e;
             }
-            else
+        }
+        else
+        {
+            /* out of chunks, the events taken so far go to the shared list */
+            while (chain != NULL)
             {
-                remaining = event->interval + period - distanceMs;
+                Event_t *e = chain;
+                chain = e->next;
+                e->next = pool->freeList;
+                pool->freeList = e;
+                pool->freeCount++;
             }
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if (chain != NULL)
+    {
+        eventpool_count_use(pool, count);
+    }
+
+    return chain;
+}
+
+static void eventpool_free(EventPool_t *pool, Event_t *event)
+{
+    EventPoolCache_t *cache = eventpool_local_cache(pool);
+
+    /* outstanding handles to this event stop matching, generation 0 is skipped so handles are never 0 */
+    uint16_t generation = (uint16_t) (event->generation + 1);
+    if (generation == 0)
+    {
+        generation++;
+    }
+    __atomic_store_n(&event->generation, generation, __ATOMIC_RELEASE);
+    event->state = EVENT_STATE_FREE;
+
+    __atomic_sub_fetch(&pool->inUse, 1, __ATOMIC_RELAXED);
+
+    pthread_spin_lock(&cache->lock);
+    event->next = cache->head;
+    cache->head = event;
+    __atomic_store_n(&cache->count, cache->count + 1, __ATOMIC_RELAXED);
+
+    if (cache->count >= 2 * EVENT_POOL_CACHE_BATCH)
+    {
+        /* give a batch back so an idle thread does not hoard free events */
+        pthread_mutex_lock(&pool->mutex);
+        for (uint32_t i = 0; i < EVENT_POOL_CACHE_BATCH; i++)
+        {
+            Event_t *e = cache->head;
+            cache->head = e->next;
+            __atomic_store_n(&cache->count, cache->count - 1, __ATOMIC_RELAXED);
+            e->next = pool->freeList;
+            pool->freeList = e;
+            pool->freeCount++;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    pthread_spin_unlock(&cache->lock);
+}
+
+/* drop one reference, the last one hands the argument to freeArgCb and the event back to the pool */
+static void eventpool_release(EventPool_t *pool, Event_t *event)
+{
+    EventCold_t *cold = eventCold(event);
+
+    if (__atomic_sub_fetch(&cold->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    if (cold->freeArgCb != NULL)
+    {
+        cold->freeArgCb(event->arg);
+    }
+    eventpool_free(pool, event);
+}
+
+/* ==================== Slot Occupancy Bitmap ==================== */
+
+static void slotbitmap_set(SlotBitmap_t *map, uint32_t index)
+{
+    map->words[index >> 6] |= 1ULL << (index & 63);
+}
+
+static void slotbitmap_reset(SlotBitmap_t *map, uint32_t index)
+{
+    map->words[index >> 6] &= ~(1ULL << (index & 63));
+}
+
+static int slotbitmap_test(const SlotBitmap_t *map, uint32_t index)
+{
+    return (map->words[index >> 6] >> (index & 63)) & 1;
+}
+
+/* index of the first set bit in [from, to), or to if there is none */
+static uint32_t slotbitmap_next(const SlotBitmap_t *map, uint32_t from, uint32_t to)
+{
+    if (from >= to)
+    {
+        return to;
+    }
+
+    uint32_t w = from >> 6;
+    uint32_t end = ((to - 1) >> 6) + 1;
+    uint64_t bits = map->words[w] & (~0ULL << (from & 63));
+
+    while (bits == 0)
+    {
+        if (++w >= end)
+        {
+            return to;
+        }
+
+        /* skip empty words four at a time, the OR chain vectorizes on both x86 and aarch64 */
+        while (w + 4 <= end && (map->words[w] | map->words[w + 1] | map->words[w + 2] | map->words[w + 3]) == 0)
+        {
+            w += 4;
+        }
+
+        if (w >= end)
+        {
+            return to;
+        }
+        bits = map->words[w];
+    }
+
+    uint32_t index = (w << 6) + (uint32_t) __builtin_ctzll(bits);
+    return index < to ? index : to;
+}
+
+/* ==================== Event Heap (4-ary) ==================== */
+
+#define EVENT_HEAP_ARITY 4
 
-            /* create a new event with remaining time */
-            Event_t *newEvent = (Event_t*) malloc(sizeof(Event_t));
-            if (newEvent != NULL)
+static uint64_t getMonotonicMs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return get_ms_by_timesp(&now);
+}
+
+static int eventheap_reserve(EventHeap_t *heap, uint32_t capacity)
+{
+    if (capacity <= heap->capacity)
+    {
+        return 0;
+    }
+
+    uint32_t newCapacity = heap->capacity == 0 ? 64 : heap->capacity;
+    while (newCapacity < capacity)
+    {
+        newCapacity *= 2;
+    }
+
+    /*
+     * Children of i are 4i+1..4i+4, so with three spare entries in front of
+     * the root every sibling group is one aligned cache line.
+     */
+    void *mem = NULL;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(EventHeapEntry_t) * (newCapacity + 3)) != 0)
+    {
+        return -1;
+    }
+
+    EventHeapEntry_t *base = (EventHeapEntry_t*) mem;
+    if (heap->size > 0)
+    {
+        memcpy(base + 3, heap->entries, sizeof(EventHeapEntry_t) * heap->size);
+    }
+
+    free(heap->base);
+    heap->base = base;
+    heap->entries = base + 3;
+    heap->capacity = newCapacity;
+
+    return 0;
+}
+
+static void eventheap_place(EventHeap_t *heap, uint32_t index, EventHeapEntry_t entry)
+{
+    heap->entries[index] = entry;
+    eventCold(entry.event)->heapIndex = index;
+}
+
+static void eventheap_sift_up(EventHeap_t *heap, uint32_t index)
+{
+    EventHeapEntry_t entry = heap->entries[index];
+
+    while (index > 0)
+    {
+        uint32_t parent = (index - 1) / EVENT_HEAP_ARITY;
+        if (heap->entries[parent].deadline <= entry.deadline)
+        {
+            break;
+        }
+
+        eventheap_place(heap, index, heap->entries[parent]);
+        index = parent;
+    }
+
+    eventheap_place(heap, index, entry);
+}
+
+static void eventheap_sift_down(EventHeap_t *heap, uint32_t index)
+{
+    EventHeapEntry_t entry = heap->entries[index];
+
+    while (1)
+    {
+        uint32_t first = index * EVENT_HEAP_ARITY + 1;
+        if (first >= heap->size)
+        {
+            break;
+        }
+
+        uint32_t last = first + EVENT_HEAP_ARITY < heap->size ? first + EVENT_HEAP_ARITY : heap->size;
+        uint32_t min = first;
+        for (uint32_t child = first + 1; child < last; child++)
+        {
+            if (heap->entries[child].deadline < heap->entries[min].deadline)
             {
-                memcpy(newEvent, event, sizeof(Event_t));
-                newEvent->next = NULL;
-                insertEventToSlot(wheel, remaining, newEvent, currentPos);
+                min = child;
             }
         }
 
-        event = next;
+        if (entry.deadline <= heap->entries[min].deadline)
+        {
+            break;
+        }
+
+        eventheap_place(heap, index, heap->entries[min]);
+        index = min;
+    }
+
+    eventheap_place(heap, index, entry);
+}
+
+static int eventheap_push(EventHeap_t *heap, Event_t *event, uint64_t deadline)
+{
+    if (eventheap_reserve(heap, heap->size + 1) != 0)
+    {
+        return -1;
+    }
+
+    EventHeapEntry_t entry = { deadline, event };
+    heap->entries[heap->size] = entry;
+    eventheap_sift_up(heap, heap->size++);
+
+    return 0;
+}
+
+/* unlink the event at its back-pointer, O(log n) */
+static void eventheap_remove(EventHeap_t *heap, Event_t *event)
+{
+    uint32_t index = eventCold(event)->heapIndex;
+
+    if (--heap->size == index)
+    {
+        return;
+    }
+
+    heap->entries[index] = heap->entries[heap->size];
+    if (index > 0 && heap->entries[(index - 1) / EVENT_HEAP_ARITY].deadline > heap->entries[index].deadline)
+    {
+        eventheap_sift_up(heap, index);
+    }
+    else
+    {
+        eventheap_sift_down(heap, index);
+    }
+}
+
+/* ==================== Latency Histograms ==================== */
+
+static uint64_t getMonotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/* values below 2^SUB_BITS get a bucket each, above that every power of two is split into 2^SUB_BITS buckets */
+static uint32_t histogram_index(uint64_t value)
+{
+    if (value < (1ULL << TIMEWHEEL_HIST_SUB_BITS))
+    {
+        return (uint32_t) value;
+    }
+
+    uint32_t msb = 63 - (uint32_t) __builtin_clzll(value);
+    uint32_t shift = msb - TIMEWHEEL_HIST_SUB_BITS;
+
+    return ((shift + 1) << TIMEWHEEL_HIST_SUB_BITS) + (uint32_t) ((value >> shift) & ((1ULL << TIMEWHEEL_HIST_SUB_BITS) - 1));
+}
+
+/* largest value that falls into bucket index */
+static uint64_t histogram_bucket_max(uint32_t index)
+{
+    if (index < (1U << TIMEWHEEL_HIST_SUB_BITS))
+    {
+        return index;
+    }
+
+    uint32_t shift = (index >> TIMEWHEEL_HIST_SUB_BITS) - 1;
+    uint64_t mantissa = (1ULL << TIMEWHEEL_HIST_SUB_BITS) + (index & ((1U << TIMEWHEEL_HIST_SUB_BITS) - 1));
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/* single writer: plain relaxed stores, readers never see torn counters */
+static void histogram_record(TimeWheelHistogram_t *hist, uint64_t value)
+{
+    uint32_t index = histogram_index(value);
+
+    __atomic_store_n(&hist->counts[index], hist->counts[index] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->count, hist->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->sum, hist->sum + value, __ATOMIC_RELAXED);
+    if (value > hist->max)
+    {
+        __atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+    }
+}
+
+/* caller's per-event histogram, its callbacks may run on several workers at once */
+static void histogram_record_shared(TimeWheelHistogram_t *hist, uint64_t value)
+{
+    __atomic_add_fetch(&hist->counts[histogram_index(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hist->sum, value, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&hist->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static void histogram_merge(TimeWheelHistogram_t *dst, const TimeWheelHistogram_t *src)
+{
+    for (uint32_t i = 0; i < TIMEWHEEL_HIST_BUCKETS; i++)
+    {
+        dst->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+    }
+    dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if (max > dst->max)
+    {
+        dst->max = max;
+    }
+}
+
+static void latency_merge(TimeWheelLatency_t *dst, const TimeWheelLatency_t *src)
+{
+    histogram_merge(&dst->lateness, &src->lateness);
+    histogram_merge(&dst->callback, &src->callback);
+    histogram_merge(&dst->tick, &src->tick);
+    histogram_merge(&dst->lockHold, &src->lockHold);
+}
+
+/* run a due callback and record how late it started and how long it took */
+static void runTimedCallback(TimeWheelLatency_t *latency, Event_t *event, EventCallback_t cb, void *arg, uint64_t dueNs,
+        uint32_t missed)
+{
+    uint64_t startNs = getMonotonicNs();
+    uint64_t lateNs = startNs > dueNs ? startNs - dueNs : 0;
+
+    t_missedRuns = missed;
+    cb(arg);
+    t_missedRuns = 0;
+
+    histogram_record(&latency->lateness, lateNs);
+    histogram_record(&latency->callback, getMonotonicNs() - startNs);
+    EventCold_t *cold = eventCold(event);
+    if (cold->lateness != NULL)
+    {
+        histogram_record_shared(cold->lateness, lateNs);
+    }
+}
+
+/* ==================== Callback Workers ==================== */
+
+/* must be called with worker->mutex held */
+static int worker_push(TimeWheelWorker_t *worker, const TimeWheelJob_t *jobs, uint32_t count)
+{
+    if (worker->count + count > worker->capacity)
+    {
+        uint32_t newCapacity = worker->capacity == 0 ? 256 : worker->capacity;
+        while (newCapacity < worker->count + count)
+        {
+            newCapacity *= 2;
+        }
+
+        TimeWheelJob_t *ring = (TimeWheelJob_t*) malloc(sizeof(TimeWheelJob_t) * newCapacity);
+        if (ring == NULL)
+        {
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < worker->count; i++)
+        {
+            ring[i] = worker->jobs[(worker->head + i) % worker->capacity];
+        }
+
+        free(worker->jobs);
+        worker->jobs = ring;
+        worker->head = 0;
+        worker->capacity = newCapacity;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        worker->jobs[(worker->head + worker->count + i) % worker->capacity] = jobs[i];
+    }
+    /* stored atomically for the lock-free check in worker_steal() */
+    __atomic_store_n(&worker->count, worker->count + count, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/* must be called with worker->mutex held */
+static int worker_pop(TimeWheelWorker_t *worker, TimeWheelJob_t *job)
+{
+    if (worker->count == 0)
+    {
+        return -1;
+    }
+
+    *job = worker->jobs[worker->head];
+    worker->head = (worker->head + 1) % worker->capacity;
+    __atomic_store_n(&worker->count, worker->count - 1, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/* take one job from a busy sibling, never blocks on its lock */
+static int worker_steal(TimeWheelWorker_t *self, TimeWheelJob_t *job)
+{
+    TimeWheelWorkerPool_t *pool = self->pool;
+    uint32_t selfIndex = (uint32_t) (self - pool->workers);
+    /* still growing while workerpool_init() starts the later workers */
+    uint32_t workerCount = __atomic_load_n(&pool->workerCount, __ATOMIC_ACQUIRE);
+
+    for (uint32_t i = 1; i < workerCount; i++)
+    {
+        TimeWheelWorker_t *victim = &pool->workers[(selfIndex + i) % workerCount];
+
+        if (__atomic_load_n(&victim->count, __ATOMIC_RELAXED) == 0 || pthread_mutex_trylock(&victim->mutex) != 0)
+        {
+            continue;
+        }
+
+        int ret = worker_pop(victim, job);
+        pthread_mutex_unlock(&victim->mutex);
+
+        if (ret == 0)
+        {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static void* workerLoop(void *arg)
+{
+    TimeWheelWorker_t *worker = (TimeWheelWorker_t*) arg;
+    TimeWheelWorkerPool_t *pool = worker->pool;
+    TimeWheelJob_t job;
+
+    while (1)
+    {
+        pthread_mutex_lock(&worker->mutex);
+        int ret = worker_pop(worker, &job);
+        pthread_mutex_unlock(&worker->mutex);
+
+        if (ret == 0 || worker_steal(worker, &job) == 0)
+        {
+            runTimedCallback(&worker->latency, job.event, job.cb, job.arg, job.dueNs, job.missed);
+            eventpool_release(pool->eventPool, job.event);
+            continue;
+        }
+
+        pthread_mutex_lock(&worker->mutex);
+        while (worker->count == 0 && !__atomic_load_n(&pool->stop, __ATOMIC_RELAXED))
+        {
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        }
+
+        /* pending jobs are still run after stop */
+        int done = worker->count == 0 && __atomic_load_n(&pool->stop, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&worker->mutex);
+
+        if (done)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int workerpool_init(TimeWheelWorkerPool_t *pool, uint32_t workerCount, EventPool_t *eventPool,
+        TimeWheelLatency_t *loopLatency)
+{
+    memset(pool, 0, sizeof(TimeWheelWorkerPool_t));
+    pool->eventPool = eventPool;
+    pool->loopLatency = loopLatency;
+
+    if (pthread_mutex_init(&pool->dispatchMutex, NULL) != 0)
+    {
+        return -1;
+    }
+
+    if (workerCount == 0)
+    {
+        return 0;
+    }
+
+    void *mem = NULL;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(TimeWheelWorker_t) * workerCount) != 0)
+    {
+        pthread_mutex_destroy(&pool->dispatchMutex);
+        return -1;
+    }
+
+    pool->workers = (TimeWheelWorker_t*) mem;
+    memset(pool->workers, 0, sizeof(TimeWheelWorker_t) * workerCount);
+
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        TimeWheelWorker_t *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        pthread_mutex_init(&worker->mutex, NULL);
+        pthread_cond_init(&worker->cond, NULL);
+
+        int ret = pthread_create(&worker->thread, NULL, workerLoop, worker);
+        if (ret != 0)
+        {
+            ERROR_TIME_LINE("create worker thread error: %s", strerror(ret));
+            pthread_cond_destroy(&worker->cond);
+            pthread_mutex_destroy(&worker->mutex);
+            break;
+        }
+        __atomic_store_n(&pool->workerCount, i + 1, __ATOMIC_RELEASE);
+    }
+
+    if (pool->workerCount != workerCount)
+    {
+        /* tear down the workers already started */
+        for (uint32_t i = 0; i < pool->workerCount; i++)
+        {
+            pthread_mutex_lock(&pool->workers[i].mutex);
+            __atomic_store_n(&pool->stop, 1, __ATOMIC_RELAXED);
+            pthread_cond_signal(&pool->workers[i].cond);
+            pthread_mutex_unlock(&pool->workers[i].mutex);
+        }
+
+        for (uint32_t i = 0; i < pool->workerCount; i++)
+        {
+            pthread_join(pool->workers[i].thread, NULL);
+            pthread_cond_destroy(&pool->workers[i].cond);
+            pthread_mutex_destroy(&pool->workers[i].mutex);
+        }
+
+        free(pool->workers);
+        pthread_mutex_destroy(&pool->dispatchMutex);
+        memset(pool, 0, sizeof(TimeWheelWorkerPool_t));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void workerpool_destroy(TimeWheelWorkerPool_t *pool)
+{
+    for (uint32_t i = 0; i < pool->workerCount; i++)
+    {
+        pthread_mutex_lock(&pool->workers[i].mutex);
+        __atomic_store_n(&pool->stop, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&pool->workers[i].cond);
+        pthread_mutex_unlock(&pool->workers[i].mutex);
+    }
+
+    for (uint32_t i = 0; i < pool->workerCount; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_cond_destroy(&pool->workers[i].cond);
+        pthread_mutex_destroy(&pool->workers[i].mutex);
+        free(pool->workers[i].jobs);
+    }
+
+    free(pool->workers);
+    free(pool->batch);
+    pthread_mutex_destroy(&pool->dispatchMutex);
+    memset(pool, 0, sizeof(TimeWheelWorkerPool_t));
+}
+
+/* wheel->mutex held: queue a due callback for the next dispatch, -1 if it has to run inline */
+static int workerpool_collect(TimeWheelWorkerPool_t *pool, Event_t *event, uint64_t dueNs, uint32_t missed)
+{
+    if (pool->batchCount == pool->batchCapacity)
+    {
+        uint32_t newCapacity = pool->batchCapacity == 0 ? 256 : pool->batchCapacity * 2;
+        TimeWheelJob_t *batch = (TimeWheelJob_t*) realloc(pool->batch, sizeof(TimeWheelJob_t) * newCapacity);
+        if (batch == NULL)
+        {
+            return -1;
+        }
+
+        pool->batch = batch;
+        pool->batchCapacity = newCapacity;
+    }
+
+    /* the job keeps the event, and so its argument, alive until the callback returned */
+    __atomic_add_fetch(&eventCold(event)->refs, 1, __ATOMIC_RELAXED);
+    pool->batch[pool->batchCount].cb = event->cb;
+    pool->batch[pool->batchCount].arg = event->arg;
+    pool->batch[pool->batchCount].event = event;
+    pool->batch[pool->batchCount].dueNs = dueNs;
+    pool->batch[pool->batchCount].missed = missed;
+    pool->batchCount++;
+
+    return 0;
+}
+
+/*
+ * Split the collected batch over the workers, one lock per worker. Called
+ * by the loop thread, or by a caller driving the wheel with dispatchMutex
+ * held since before it collected.
+ */
+static void workerpool_dispatch(TimeWheelWorkerPool_t *pool)
+{
+    uint32_t total = pool->batchCount;
+    uint32_t offset = 0;
+
+    if (total == 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < pool->workerCount && offset < total; i++)
+    {
+        uint32_t share = total / pool->workerCount + (i < total % pool->workerCount ? 1 : 0);
+        TimeWheelWorker_t *worker = &pool->workers[(pool->nextWorker + i) % pool->workerCount];
+
+        pthread_mutex_lock(&worker->mutex);
+        int ret = worker_push(worker, &pool->batch[offset], share);
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->mutex);
+
+        if (ret != 0)
+        {
+            /* no memory for the ring, run this share here rather than drop it */
+            for (uint32_t j = 0; j < share; j++)
+            {
+                TimeWheelJob_t *job = &pool->batch[offset + j];
+                runTimedCallback(pool->loopLatency, job->event, job->cb, job->arg, job->dueNs, job->missed);
+                eventpool_release(pool->eventPool, job->event);
+            }
+        }
+        offset += share;
+    }
+
+    pool->nextWorker = (pool->nextWorker + 1) % pool->workerCount;
+    pool->batchCount = 0;
+}
+
+/* ==================== TimeWheel Internal Functions ==================== */
+
+#define US_PER_SEC      1000000ULL
+#define US_PER_MIN      (60 * US_PER_SEC)
+
+static uint64_t getCurrentUs(TimeWheel_t *wheel, TimePos_t timePos)
+{
+    return (uint64_t) wheel->stepUs * timePos.pos_ms + timePos.pos_sec * US_PER_SEC + timePos.pos_min * US_PER_MIN;
+}
+
+static TimePos_t advanceTimePos(TimeWheel_t *wheel, TimePos_t pos, uint64_t ticks)
+{
+    uint64_t period = wheel->thirdLevelCount * US_PER_MIN;
+    uint64_t futureUs = (getCurrentUs(wheel, pos) + ticks % (period / wheel->stepUs) * wheel->stepUs) % period;
+    TimePos_t next;
+
+    next.pos_min = (uint32_t) (futureUs / US_PER_MIN);
+    next.pos_sec = (uint32_t) (futureUs % US_PER_MIN / US_PER_SEC);
+    next.pos_ms = (uint32_t) (futureUs % US_PER_SEC / wheel->stepUs);
+
+    return next;
+}
+
+/* the slot visited when the wheel steps onto pos: the highest level whose position just changed */
+static uint32_t slotIndexForPos(TimeWheel_t *wheel, TimePos_t pos)
+{
+    if (pos.pos_ms != 0)
+    {
+        return pos.pos_ms;
+    }
+
+    if (pos.pos_sec != 0 || wheel->thirdLevelCount == 1)
+    {
+        return wheel->firstLevelCount + pos.pos_sec;
+    }
+
+    return wheel->firstLevelCount + wheel->secondLevelCount + pos.pos_min;
+}
+
+static SlotBitmap_t* slotLevelBitmap(TimeWheel_t *wheel, uint32_t slotIndex, uint32_t *bit)
+{
+    if (slotIndex < wheel->firstLevelCount)
+    {
+        *bit = slotIndex;
+        return &wheel->levelBitmap[0];
+    }
+
+    if (slotIndex < wheel->firstLevelCount + wheel->secondLevelCount)
+    {
+        *bit = slotIndex - wheel->firstLevelCount;
+        return &wheel->levelBitmap[1];
+    }
+
+    *bit = slotIndex - wheel->firstLevelCount - wheel->secondLevelCount;
+    return &wheel->levelBitmap[2];
+}
+
+static void wheelslot_push_back(TimeWheel_t *wheel, uint32_t slotIndex, Event_t *event)
+{
+    WheelSlot_t *slot = &wheel->eventSlotArray.slots[slotIndex];
+    uint32_t bit;
+    SlotBitmap_t *map = slotLevelBitmap(wheel, slotIndex, &bit);
+
+    event->slotNext = EVENT_INDEX_NONE;
+    event->slotPrev = slot->tail;
+    if (slot->tail == EVENT_INDEX_NONE)
+    {
+        slot->head = event->index;
+    }
+    else
+    {
+        eventpool_at(&wheel->pool, slot->tail)->slotNext = event->index;
+    }
+    slot->tail = event->index;
+
+    eventCold(event)->slotIndex = slotIndex;
+    event->state = EVENT_STATE_SLOT;
+
+    slotbitmap_set(map, bit);
+}
+
+/* unlink an event from slotIndex, the bitmap bit goes when the slot runs empty */
+static void wheelslot_remove(TimeWheel_t *wheel, uint32_t slotIndex, Event_t *event)
+{
+    WheelSlot_t *slot = &wheel->eventSlotArray.slots[slotIndex];
+    uint32_t bit;
+
+    if (event->slotPrev == EVENT_INDEX_NONE)
+    {
+        slot->head = event->slotNext;
+    }
+    else
+    {
+        eventpool_at(&wheel->pool, event->slotPrev)->slotNext = event->slotNext;
+    }
+
+    if (event->slotNext == EVENT_INDEX_NONE)
+    {
+        slot->tail = event->slotPrev;
+    }
+    else
+    {
+        eventpool_at(&wheel->pool, event->slotNext)->slotPrev = event->slotPrev;
+    }
+
+    event->slotNext = EVENT_INDEX_NONE;
+    event->slotPrev = EVENT_INDEX_NONE;
+
+    if (slot->head == EVENT_INDEX_NONE)
+    {
+        SlotBitmap_t *map = slotLevelBitmap(wheel, slotIndex, &bit);
+        slotbitmap_reset(map, bit);
+    }
+}
+
+/* take one event off whatever slot it is linked into */
+static void wheelslot_unlink(TimeWheel_t *wheel, Event_t *event)
+{
+    wheelslot_remove(wheel, eventCold(event)->slotIndex, event);
+}
+
+/*
+ * Number of ticks from pos until the wheel steps onto an occupied slot, or
+ * UINT64_MAX if no occupied slot is reached within limit ticks. Empty slots
+ * are skipped a whole word, second or minute at a time.
+ */
+static uint64_t ticksToNextSlot(TimeWheel_t *wheel, TimePos_t pos, uint64_t limit)
+{
+    const uint32_t first = wheel->firstLevelCount;
+    const uint32_t third = wheel->thirdLevelCount;
+    const SlotBitmap_t *msMap = &wheel->levelBitmap[0];
+    const SlotBitmap_t *secMap = &wheel->levelBitmap[1];
+    const SlotBitmap_t *minMap = &wheel->levelBitmap[2];
+
+    /* every visited slot comes round within one period, anything beyond that is never visited */
+    const uint64_t period = (uint64_t) first * 60 * third;
+    if (limit > period)
+    {
+        limit = period;
+    }
+
+    /* millisecond slots left in the current second */
+    uint32_t index = slotbitmap_next(msMap, pos.pos_ms + 1, first);
+    if (index < first)
+    {
+        return index - pos.pos_ms <= limit ? index - pos.pos_ms : UINT64_MAX;
+    }
+
+    /* millisecond slot 0 is never visited, a second boundary is processed instead */
+    const uint32_t msLow = slotbitmap_next(msMap, 1, first);
+    uint64_t dist = first - pos.pos_ms;
+    uint32_t sec = (pos.pos_sec + 1) % 60;
+    uint32_t min = sec == 0 ? (pos.pos_min + 1) % third : pos.pos_min;
+
+    while (dist <= limit)
+    {
+        /* (sec, min) is the second boundary dist ticks away */
+        if (sec == 0 && third > 1 ? slotbitmap_test(minMap, min) : slotbitmap_test(secMap, sec))
+        {
+            return dist;
+        }
+
+        if (msLow < first)
+        {
+            return dist + msLow <= limit ? dist + msLow : UINT64_MAX;
+        }
+
+        /* only second and minute slots are left: jump to the next occupied second */
+        index = slotbitmap_next(secMap, sec + 1, 60);
+        if (index < 60)
+        {
+            dist += (uint64_t) (index - sec) * first;
+            sec = index;
+            continue;
+        }
+
+        /* otherwise to the next minute boundary */
+        dist += (uint64_t) (60 - sec) * first;
+        sec = 0;
+        if (third == 1)
+        {
+            continue;
+        }
+        min = (min + 1) % third;
+
+        if (slotbitmap_test(minMap, min) || slotbitmap_next(secMap, 1, 60) < 60)
+        {
+            continue;
+        }
+
+        /* nothing below the minute level: skip whole empty minutes */
+        index = slotbitmap_next(minMap, min + 1, third);
+        if (index == third)
+        {
+            index = slotbitmap_next(minMap, 0, min);
+            if (index == min)
+            {
+                return UINT64_MAX;
+            }
+            index += third;
+        }
+
+        dist += (uint64_t) (index - min) * first * 60;
+        min = index % third;
+    }
+
+    return UINT64_MAX;
+}
+
+/* events are identified by handles, the counter only feeds timewheel_get_stats() */
+static void countCreatedEvents(TimeWheel_t *wheel, uint32_t count)
+{
+    __atomic_fetch_add(&wheel->increaseId, count, __ATOMIC_RELAXED);
+}
+
+/*
+ * Wheel tick of the current time, read from the clock. A tickless loop only
+ * moves currentTick when it wakes up, so producers must not count from it.
+ * A manual wheel has no other clock than currentTick.
+ */
+static uint64_t wheelTickNow(TimeWheel_t *wheel)
+{
+    if (wheel->mode == TIMEWHEEL_MODE_MANUAL)
+    {
+        return __atomic_load_n(&wheel->currentTick, __ATOMIC_ACQUIRE);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int64_t elapsedNs = (int64_t) (now.tv_sec - wheel->startTime.tv_sec) * 1000000000LL +
+            (int64_t) (now.tv_nsec - wheel->startTime.tv_nsec);
+
+    return elapsedNs > 0 ? (uint64_t) (elapsedNs / ((int64_t) wheel->stepUs * 1000LL)) : 0;
+}
+
+/* ==================== Wall-Clock Schedules ==================== */
+
+/* one cron field: "*", "?", "a" or "a-b", each with an optional "/step", separated by commas */
+static int cronParseField(const char *field, size_t len, int lo, int hi, uint64_t *bits)
+{
+    const char *end = field + len;
+    const char *p = field;
+
+    *bits = 0;
+    while (p < end)
+    {
+        long first = lo;
+        long last = hi;
+        long step = 1;
+        char *next;
+
+        if (*p == '*' || *p == '?')
+        {
+            p++;
+        }
+        else
+        {
+            first = strtol(p, &next, 10);
+            if (next == p)
+            {
+                return -1;
+            }
+            p = next;
+            last = first;
+            if (p < end && *p == '-')
+            {
+                last = strtol(++p, &next, 10);
+                if (next == p)
+                {
+                    return -1;
+                }
+                p = next;
+            }
+            else if (p < end && *p == '/')
+            {
+                /* "a/step" runs from a to the end of the range */
+                last = hi;
+            }
+        }
+
+        if (p < end && *p == '/')
+        {
+            step = strtol(++p, &next, 10);
+            if (next == p || step <= 0)
+            {
+                return -1;
+            }
+            p = next;
+        }
+
+        if (first < lo || last > hi || first > last || (p < end && *p != ','))
+        {
+            return -1;
+        }
+        for (long v = first; v <= last; v += step)
+        {
+            *bits |= 1ULL << v;
+        }
+        if (p < end && ++p == end)
+        {
+            return -1;
+        }
+    }
+
+    return *bits != 0 ? 0 : -1;
+}
+
+static int cronFieldIsAny(const char *field, size_t len)
+{
+    return len == 1 && (field[0] == '*' || field[0] == '?');
+}
+
+int timewheel_cron_parse(TimeWheelCron_t *cron, const char *expr)
+{
+    static const int lo[6] = { 0, 0, 0, 1, 1, 0 };
+    static const int hi[6] = { 59, 59, 23, 31, 12, 7 };
+    const char *fields[6];
+    size_t lens[6];
+    uint64_t bits[6];
+    uint32_t count = 0;
+
+    if (cron == NULL || expr == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    for (const char *p = expr; *p != '\0';)
+    {
+        if (*p == ' ' || *p == '\t')
+        {
+            p++;
+            continue;
+        }
+        if (count == ARRAY_SIZE(fields))
+        {
+            ERROR_TIME_LINE("invalid cron expression: %s", expr);
+            return -1;
+        }
+        fields[count] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t')
+        {
+            p++;
+        }
+        lens[count] = (size_t) (p - fields[count]);
+        count++;
+    }
+
+    if (count < 5)
+    {
+        ERROR_TIME_LINE("invalid cron expression: %s", expr);
+        return -1;
+    }
+
+    /* seconds minutes hours day-of-month month day-of-week, classic five-field cron runs at second 0 */
+    uint32_t first = 6 - count;
+    bits[0] = 1;
+    for (uint32_t i = first; i < 6; i++)
+    {
+        if (cronParseField(fields[i - first], lens[i - first], lo[i], hi[i], &bits[i]) != 0)
+        {
+            ERROR_TIME_LINE("invalid cron expression: %s", expr);
+            return -1;
+        }
+    }
+
+    memset(cron, 0, sizeof(*cron));
+    cron->seconds = bits[0];
+    cron->minutes = bits[1];
+    cron->hours = (uint32_t) bits[2];
+    cron->daysOfMonth = (uint32_t) bits[3];
+    cron->months = (uint16_t) bits[4];
+    cron->daysOfWeek = (uint8_t) ((bits[5] | bits[5] >> 7) & 0x7F); /* 7 is Sunday as well */
+    if (cronFieldIsAny(fields[3 - first], lens[3 - first]))
+    {
+        cron->flags |= TIMEWHEEL_CRON_ANY_DOM;
+    }
+    if (cronFieldIsAny(fields[5 - first], lens[5 - first]))
+    {
+        cron->flags |= TIMEWHEEL_CRON_ANY_DOW;
+    }
+
+    return 0;
+}
+
+/* like cron, a day matches either restricted day field when both are restricted */
+static int cronDayMatches(const TimeWheelCron_t *cron, const struct tm *tm)
+{
+    int dom = (cron->daysOfMonth >> tm->tm_mday) & 1;
+    int dow = (cron->daysOfWeek >> tm->tm_wday) & 1;
+
+    if ((cron->flags & TIMEWHEEL_CRON_ANY_DOM) != 0)
+    {
+        return dow;
+    }
+    if ((cron->flags & TIMEWHEEL_CRON_ANY_DOW) != 0)
+    {
+        return dom;
+    }
+
+    return dom | dow;
+}
+
+/*
+ * Normalise tm after a field was moved on and return the first time after
+ * prev it can stand for. A local time of the DST fall-back hour has two
+ * offsets: keeping the one of prev walks through the repeated hour in
+ * order, a fresh lookup is right after a jump across a DST change, so the
+ * earlier of the two that is still after prev wins. A local time the DST
+ * change skipped becomes the time after it.
+ */
+static time_t cronMakeTime(const TimeWheelCron_t *cron, struct tm *tm, time_t prev)
+{
+    time_t t;
+
+    if ((cron->flags & TIMEWHEEL_CRON_UTC) != 0)
+    {
+        t = timegm(tm);
+    }
+    else
+    {
+        struct tm fresh = *tm;
+
+        /* tm_isdst is still the one the last localtime_r() returned */
+        t = mktime(tm);
+        fresh.tm_isdst = -1;
+        time_t freshT = mktime(&fresh);
+        if (freshT > prev && (t <= prev || freshT < t))
+        {
+            t = freshT;
+        }
+    }
+
+    if (t <= prev)
+    {
+        /* neither reading moved forward, step a second so the search cannot go back */
+        t = prev + 1;
+    }
+
+    if ((cron->flags & TIMEWHEEL_CRON_UTC) != 0)
+    {
+        gmtime_r(&t, tm);
+    }
+    else
+    {
+        localtime_r(&t, tm);
+    }
+
+    return t;
+}
+
+/*
+ * First matching second strictly after afterUs. The coarsest field that
+ * does not match is moved on and everything below it reset, so a search
+ * skips whole months and days instead of walking second by second. A
+ * schedule that does not match within eight years, e.g. "0 0 0 30 2 *",
+ * never matches.
+ */
+int timewheel_cron_next(const TimeWheelCron_t *cron, uint64_t afterUs, uint64_t *nextUs)
+{
+    if (cron == NULL || nextUs == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    time_t t = (time_t) (afterUs / US_PER_SEC) + 1;
+    struct tm tm;
+
+    if ((cron->flags & TIMEWHEEL_CRON_UTC) != 0)
+    {
+        gmtime_r(&t, &tm);
+    }
+    else
+    {
+        localtime_r(&t, &tm);
+    }
+
+    for (int lastYear = tm.tm_year + 8; tm.tm_year <= lastYear; t = cronMakeTime(cron, &tm, t))
+    {
+        uint64_t seconds = tm.tm_sec < 60 ? cron->seconds >> tm.tm_sec : 0;
+
+        if (((cron->months >> (tm.tm_mon + 1)) & 1) == 0)
+        {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        }
+        else if (!cronDayMatches(cron, &tm))
+        {
+            tm.tm_mday++;
+            tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        }
+        else if (((cron->hours >> tm.tm_hour) & 1) == 0)
+        {
+            tm.tm_hour++;
+            tm.tm_min = tm.tm_sec = 0;
+        }
+        else if (((cron->minutes >> tm.tm_min) & 1) == 0)
+        {
+            tm.tm_min++;
+            tm.tm_sec = 0;
+        }
+        else if (seconds == 0)
+        {
+            tm.tm_min++;
+            tm.tm_sec = 0;
+        }
+        else if ((seconds & 1) == 0)
+        {
+            tm.tm_sec += __builtin_ctzll(seconds);
+        }
+        else
+        {
+            *nextUs = (uint64_t) t * US_PER_SEC;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * CLOCK_REALTIME time of tick 0 as both clocks see it now. It moves when
+ * the clock is set or slewed, the loop thread follows in syncWallClock().
+ */
+static uint64_t readRealStartUs(TimeWheel_t *wheel)
+{
+    struct timespec real;
+    struct timespec mono;
+
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+
+    int64_t elapsedUs = (int64_t) (mono.tv_sec - wheel->startTime.tv_sec) * 1000000LL +
+            (int64_t) (mono.tv_nsec - wheel->startTime.tv_nsec) / 1000;
+
+    return (uint64_t) real.tv_sec * US_PER_SEC + (uint64_t) real.tv_nsec / 1000 - (uint64_t) elapsedUs;
+}
+
+/* first tick at or after a CLOCK_REALTIME time, read without the lock by producers for their wake up hint */
+static uint64_t wallToTick(TimeWheel_t *wheel, uint64_t wallUs)
+{
+    uint64_t startUs = __atomic_load_n(&wheel->realStartUs, __ATOMIC_RELAXED);
+
+    return wallUs > startUs ? (wallUs - startUs + wheel->stepUs - 1) / wheel->stepUs : 0;
+}
+
+static uint64_t tickToWall(TimeWheel_t *wheel, uint64_t tick)
+{
+    return __atomic_load_n(&wheel->realStartUs, __ATOMIC_RELAXED) + tick * wheel->stepUs;
+}
+
+/* CLOCK_REALTIME now in microseconds, a manual wheel's virtual now on the wall clock of its creation */
+static uint64_t wallNowUs(TimeWheel_t *wheel)
+{
+    if (wheel->mode == TIMEWHEEL_MODE_MANUAL)
+    {
+        return tickToWall(wheel, __atomic_load_n(&wheel->currentTick, __ATOMIC_ACQUIRE));
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (uint64_t) now.tv_sec * US_PER_SEC + (uint64_t) now.tv_nsec / 1000;
+}
+
+/* next run of a cron or TIMEWHEEL_EVENT_WALLCLOCK event strictly after afterUs, UINT64_MAX if the cron never matches again */
+static uint64_t nextWallUs(Event_t *event, uint64_t afterUs)
+{
+    const TimeWheelCron_t *cron = eventCold(event)->cron;
+    uint64_t nextUs;
+
+    if (cron != NULL)
+    {
+        return timewheel_cron_next(cron, afterUs, &nextUs) == 0 ? nextUs : UINT64_MAX;
+    }
+
+    return (afterUs / event->intervalUs + 1) * event->intervalUs;
+}
+
+/* cron and TIMEWHEEL_EVENT_WALLCLOCK events stay on the wall clock, an atUs event only for its first run */
+static int isWallPeriodic(Event_t *event)
+{
+    return (event->flags & TIMEWHEEL_EVENT_WALLCLOCK) != 0 || eventCold(event)->cron != NULL;
+}
+
+/*
+ * Position an event with slack is placed at, between dueUs and slackTicks
+ * later. Events share slots this way: a minute or second boundary in the
+ * window is visited anyway and takes the event without cascading, otherwise
+ * an already occupied millisecond slot of this second, otherwise the most
+ * aligned tick, which independent timers with similar windows agree on.
+ */
+static uint64_t coalesceUs(TimeWheel_t *wheel, uint64_t curUs, uint64_t dueUs, uint32_t slackTicks)
+{
+    const uint64_t periodUs = (uint64_t) wheel->thirdLevelCount * US_PER_MIN;
+    uint64_t lastUs = dueUs + (uint64_t) slackTicks * wheel->stepUs;
+
+    /* a position a full period away would be visited one period early */
+    if (lastUs >= curUs + periodUs)
+    {
+        lastUs = curUs + periodUs - wheel->stepUs;
+    }
+    if (lastUs <= dueUs)
+    {
+        return dueUs;
+    }
+
+    uint64_t boundaryUs = (dueUs + US_PER_MIN - 1) / US_PER_MIN * US_PER_MIN;
+    if (boundaryUs <= lastUs)
+    {
+        return boundaryUs;
+    }
+
+    boundaryUs = (dueUs + US_PER_SEC - 1) / US_PER_SEC * US_PER_SEC;
+    if (boundaryUs <= lastUs)
+    {
+        return boundaryUs;
+    }
+
+    uint64_t dueTick = dueUs / wheel->stepUs;
+    uint64_t lastTick = lastUs / wheel->stepUs;
+
+    /* the millisecond bitmap only describes the current second */
+    if (dueUs / US_PER_SEC == curUs / US_PER_SEC)
+    {
+        uint32_t from = (uint32_t) (dueUs % US_PER_SEC / wheel->stepUs);
+        uint32_t to = from + (uint32_t) (lastTick - dueTick) + 1;
+        uint32_t index = slotbitmap_next(&wheel->levelBitmap[0], from, to);
+        if (index < to)
+        {
+            return dueUs + (uint64_t) (index - from) * wheel->stepUs;
+        }
+    }
+
+    /* keep the bits above the highest one in which the ends of the window differ */
+    uint64_t alignTicks = 1ULL << (63 - __builtin_clzll(dueTick ^ lastTick));
+    return (lastTick & ~(alignTicks - 1)) * wheel->stepUs;
+}
+
+static int insertEventToSlot(TimeWheel_t *wheel, uint64_t intervalUs, Event_t *event, TimePos_t basePos)
+{
+    /*
+     * Pick the level by whole seconds and minutes rather than by slot
+     * position: an interval close to the wheel period lands on the position
+     * it started from. A slot may be visited before the event is due,
+     * processEvent() then moves it further down.
+     */
+    uint64_t curUs = getCurrentUs(wheel, basePos);
+    uint64_t futureUs = curUs + intervalUs;
+
+    if ((event->flags & EVENT_FLAG_SLACK) != 0 && intervalUs != 0)
+    {
+        futureUs = coalesceUs(wheel, curUs, futureUs, eventCold(event)->slackTicks);
+    }
+
+    /* determine which level slot to insert */
+    uint32_t slotIndex;
+    if (intervalUs == 0)
+    {
+        /* should not happen, but handle it */
+        return -1;
+    }
+    else if (futureUs / US_PER_SEC == curUs / US_PER_SEC)
+    {
+        /* insert to first level slot */
+        slotIndex = (uint32_t) (futureUs % US_PER_SEC / wheel->stepUs);
+    }
+    else if (futureUs / US_PER_MIN == curUs / US_PER_MIN || wheel->thirdLevelCount == 1)
+    {
+        /* insert to second slot, a single minute slot is never visited */
+        slotIndex = wheel->firstLevelCount + (uint32_t) (futureUs % US_PER_MIN / US_PER_SEC);
+    }
+    else
+    {
+        /* insert to minute slot */
+        slotIndex = wheel->firstLevelCount + wheel->secondLevelCount + (uint32_t) (futureUs / US_PER_MIN % wheel->thirdLevelCount);
+    }
+
+    wheelslot_push_back(wheel, slotIndex, event);
+    return 0;
+}
+
+/*
+ * Place an event that is due in ticks from now. Anything a full wheel period
+ * or more away waits in the overflow heap under its absolute due tick, so the
+ * horizon does not depend on the number of minute slots.
+ */
+static int scheduleEvent(TimeWheel_t *wheel, Event_t *event, uint64_t ticks)
+{
+    const uint64_t periodTicks = (uint64_t) wheel->firstLevelCount * wheel->secondLevelCount * wheel->thirdLevelCount;
+
+    if (ticks < periodTicks)
+    {
+        return insertEventToSlot(wheel, ticks * wheel->stepUs, event, wheel->timePos);
+    }
+
+    if (eventheap_push(&wheel->overflow, event, wheel->currentTick + ticks) != 0)
+    {
+        return -1;
+    }
+    event->state = EVENT_STATE_OVERFLOW;
+
+    return 0;
+}
+
+/* ticks until the earliest overflow event has to move into the slots, UINT64_MAX if there is none */
+static uint64_t ticksToCascade(TimeWheel_t *wheel)
+{
+    const uint64_t periodTicks = (uint64_t) wheel->firstLevelCount * wheel->secondLevelCount * wheel->thirdLevelCount;
+
+    if (wheel->overflow.size == 0)
+    {
+        return UINT64_MAX;
+    }
+
+    uint64_t cascadeTick = wheel->overflow.entries[0].deadline - (periodTicks - 1);
+    return cascadeTick > wheel->currentTick ? cascadeTick - wheel->currentTick : 0;
+}
+
+/* move the overflow events that came within one wheel period into their slots */
+static void cascadeOverflow(TimeWheel_t *wheel)
+{
+    while (ticksToCascade(wheel) == 0)
+    {
+        Event_t *event = wheel->overflow.entries[0].event;
+        uint64_t deadline = wheel->overflow.entries[0].deadline;
+        uint64_t ticks = deadline > wheel->currentTick ? deadline - wheel->currentTick : 1;
+
+        eventheap_remove(&wheel->overflow, event);
+        if (insertEventToSlot(wheel, ticks * wheel->stepUs, event, wheel->timePos) != 0)
+        {
+            eventpool_release(&wheel->pool, event);
+        }
+    }
+}
+
+/* NTP slewing moves CLOCK_REALTIME this far before the wall-clock events are re-placed */
+#define WALL_SYNC_MIN_US        10000
+
+/* a registered wall-clock event that still belongs to the registration */
+static int wallEventLive(const TimeWheelWallEvent_t *entry)
+{
+    const Event_t *event = entry->event;
+
+    return event->generation == entry->generation && (event->flags & EVENT_FLAG_WALL) != 0 &&
+            event->state != EVENT_STATE_FREE && event->state != EVENT_STATE_CANCELLED;
+}
+
+/* drop the entries of events that finished, then make room for at least one more */
+static int wallEventsReserve(TimeWheel_t *wheel)
+{
+    uint32_t kept = 0;
+
+    if (wheel->wallCount < wheel->wallCapacity)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < wheel->wallCount; i++)
+    {
+        if (wallEventLive(&wheel->wallEvents[i]))
+        {
+            wheel->wallEvents[kept++] = wheel->wallEvents[i];
+        }
+    }
+    __atomic_store_n(&wheel->wallCount, kept, __ATOMIC_RELAXED);
+
+    /* grow while half or more is live, so compacting stays rare */
+    if (kept >= wheel->wallCapacity / 2)
+    {
+        uint32_t capacity = wheel->wallCapacity != 0 ? wheel->wallCapacity * 2 : 64;
+        TimeWheelWallEvent_t *events = realloc(wheel->wallEvents, capacity * sizeof(*events));
+
+        if (events == NULL)
+        {
+            return kept < wheel->wallCapacity ? 0 : -1;
+        }
+        wheel->wallEvents = events;
+        wheel->wallCapacity = capacity;
+    }
+
+    return 0;
+}
+
+/*
+ * A wall-clock event leaves the producer with its first CLOCK_REALTIME due
+ * time in touch, which such an event has no other use for. Put it on the
+ * tick of that time and register it to be moved when the clock is set.
+ * Must be called with wheel->mutex held.
+ */
+static void placeWallEvent(TimeWheel_t *wheel, Event_t *event)
+{
+    uint64_t intervalTicks = event->intervalUs / wheel->stepUs;
+
+    if (wheel->mode == TIMEWHEEL_MODE_TICK && wheel->wallCount == 0)
+    {
+        /* syncWallClock() skipped this wheel while it had no wall-clock events */
+        __atomic_store_n(&wheel->realStartUs, readRealStartUs(wheel), __ATOMIC_RELAXED);
+    }
+
+    /* due = baseTick + interval, which wraps back when the due tick is less than one interval in */
+    event->baseTick = wallToTick(wheel, event->touch) - intervalTicks;
+    event->touch = 0;
+
+    if (wallEventsReserve(wheel) != 0)
+    {
+        ERROR_TIME_LINE("failed to register wall-clock event, it will not follow clock changes");
+        return;
+    }
+    wheel->wallEvents[wheel->wallCount].event = event;
+    wheel->wallEvents[wheel->wallCount].generation = event->generation;
+    __atomic_store_n(&wheel->wallCount, wheel->wallCount + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Follow CLOCK_REALTIME. The wheel runs on CLOCK_MONOTONIC, so when the
+ * clock was set, or slewed by WALL_SYNC_MIN_US or a tick, only the
+ * registered wall-clock events move: each keeps its wall time and is put on
+ * the tick that time has now, firing on the next tick if that passed.
+ * Interval events are not touched. Must be called with wheel->mutex held.
+ */
+static void syncWallClock(TimeWheel_t *wheel)
+{
+    if (wheel->mode == TIMEWHEEL_MODE_MANUAL)
+    {
+        return;
+    }
+
+    /*
+     * Nothing to move. A tick loop would read both clocks every tick for it,
+     * placeWallEvent() catches realStartUs up instead. The other modes wake
+     * rarely and keep it fresh for the due ticks producers compute unlocked.
+     */
+    if (wheel->mode == TIMEWHEEL_MODE_TICK && wheel->wallCount == 0)
+    {
+        return;
+    }
+
+    uint64_t oldStartUs = wheel->realStartUs;
+    uint64_t newStartUs = readRealStartUs(wheel);
+    uint64_t movedUs = newStartUs > oldStartUs ? newStartUs - oldStartUs : oldStartUs - newStartUs;
+    if (movedUs < WALL_SYNC_MIN_US || movedUs < wheel->stepUs)
+    {
+        return;
+    }
+
+    DEBUG_TIME_LINE("CLOCK_REALTIME moved by %lld us, re-placing %u wall-clock events",
+            (long long) (newStartUs - oldStartUs), wheel->wallCount);
+    __atomic_store_n(&wheel->realStartUs, newStartUs, __ATOMIC_RELAXED);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < wheel->wallCount; i++)
+    {
+        TimeWheelWallEvent_t entry = wheel->wallEvents[i];
+        Event_t *event = entry.event;
+
+        /* a second entry of an event already moved is dropped with the stale ones */
+        if (!wallEventLive(&entry) || (event->flags & EVENT_FLAG_WALL_MOVED) != 0)
+        {
+            continue;
+        }
+        wheel->wallEvents[kept++] = entry;
+        event->flags |= EVENT_FLAG_WALL_MOVED;
+
+        if (event->state != EVENT_STATE_SLOT && event->state != EVENT_STATE_OVERFLOW)
+        {
+            continue;
+        }
+
+        uint64_t intervalTicks = event->intervalUs / wheel->stepUs;
+        uint64_t dueUs = oldStartUs + (event->baseTick + intervalTicks) * wheel->stepUs;
+
+        if (event->state == EVENT_STATE_SLOT)
+        {
+            wheelslot_unlink(wheel, event);
+        }
+        else
+        {
+            eventheap_remove(&wheel->overflow, event);
+        }
+
+        event->baseTick = wallToTick(wheel, dueUs) - intervalTicks;
+        uint64_t dueTick = event->baseTick + intervalTicks;
+        if (scheduleEvent(wheel, event, dueTick > wheel->currentTick ? dueTick - wheel->currentTick : 1) != 0)
+        {
+            eventpool_release(&wheel->pool, event);
+        }
+    }
+
+    for (uint32_t i = 0; i < kept; i++)
+    {
+        wheel->wallEvents[i].event->flags &= (uint8_t) ~EVENT_FLAG_WALL_MOVED;
+    }
+    __atomic_store_n(&wheel->wallCount, kept, __ATOMIC_RELAXED);
+}
+
+static uint32_t processEvent(TimeWheel_t *wheel, uint32_t slotIndex)
+{
+    WheelSlot_t *slot = &wheel->eventSlotArray.slots[slotIndex];
+    Event_t *event;
+
+    __atomic_store_n(&wheel->slotsVisited, wheel->slotsVisited + 1, __ATOMIC_RELAXED);
+
+    /*
+     * Take one event off the slot at a time, a callback may cancel or modify
+     * the events still linked here. Events are relinked into their next slot,
+     * which is never the one being processed.
+     */
+    while (slot->head != EVENT_INDEX_NONE)
+    {
+        event = eventpool_at(&wheel->pool, slot->head);
+        wheelslot_remove(wheel, slotIndex, event);
+        event->state = EVENT_STATE_FIRING;
+
+        /* the interval counts from baseTick, in 64-bit ticks so it may span more than one wheel period */
+        uint64_t dueTick = event->baseTick + event->intervalUs / wheel->stepUs;
+        uint64_t remaining;
+
+        /* a touch only counts for the generation that recorded it and after the interval started */
+        uint64_t touchTick = __atomic_load_n(&event->touch, __ATOMIC_RELAXED);
+
+        if (dueTick <= wheel->currentTick && (touchTick >> 48) == event->generation &&
+                (touchTick &= (1ULL << 48) - 1) > event->baseTick)
+        {
+            /* touched since it was scheduled: due interval after the last touch, which slack may already have passed */
+            event->baseTick = touchTick;
+            dueTick = touchTick + event->intervalUs / wheel->stepUs;
+        }
+
+        if (dueTick > wheel->currentTick)
+        {
+            /* cascaded down from a coarser level or touched, not due yet */
+            remaining = dueTick - wheel->currentTick;
+        }
+        else
+        {
+            EventCold_t *cold = eventCold(event);
+            uint64_t intervalTicks = event->intervalUs / wheel->stepUs;
+            uint64_t missed = 0;
+
+            /* a periodic event behind the clock runs once for the periods it missed, unless it wants them all */
+            if ((event->flags & EVENT_FLAGS_OVERRUN) != 0 && cold->repeat != 1 && cold->cron == NULL)
+            {
+                missed = missedPeriods(dueTick, intervalTicks, wheel->clockTick);
+            }
+
+            /* process event, on a worker unless it asked for the loop thread */
+            uint64_t dueNs = (uint64_t) wheel->startTime.tv_sec * 1000000000ULL + (uint64_t) wheel->startTime.tv_nsec +
+                    dueTick * wheel->stepUs * 1000ULL;
+            if (wheel->mode == TIMEWHEEL_MODE_MANUAL)
+            {
+                /* virtual time is never late, only the hand over to a worker is measured */
+                dueNs = getMonotonicNs();
+            }
+            if (wheel->workers.workerCount == 0 || (event->flags & TIMEWHEEL_EVENT_INLINE) != 0 ||
+                    workerpool_collect(&wheel->workers, event, dueNs, clampMissed(missed)) != 0)
+            {
+                runTimedCallback(&wheel->latency, event, event->cb, event->arg, dueNs, clampMissed(missed));
+            }
+            __atomic_store_n(&wheel->firedCount, wheel->firedCount + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&wheel->missedCount, wheel->missedCount + missed, __ATOMIC_RELAXED);
+
+            if (cold->repeat != 0 && --cold->repeat == 0)
+            {
+                /* that was the last run, a queued callback still holds its own reference */
+                __atomic_store_n(&event->state, EVENT_STATE_CANCELLED, __ATOMIC_RELAXED);
+            }
+
+            if (event->state == EVENT_STATE_CANCELLED)
+            {
+                /* finished, or the callback cancelled its own event */
+                eventpool_release(&wheel->pool, event);
+                continue;
+            }
+
+            /*
+             * Reschedule the same event for next trigger, the callback may
+             * have changed the interval. FIRE_ALL counts from the tick being
+             * processed, so a wheel catching up runs every missed period in
+             * turn; FIRE_ONCE counts from the clock; SKIP keeps the phase of
+             * the original schedule. A wall-clock schedule has its phase on
+             * CLOCK_REALTIME, so both policies that fold missed runs take the
+             * first wall time after the clock.
+             */
+            if ((event->flags & EVENT_FLAG_WALL) != 0 && isWallPeriodic(event))
+            {
+                uint64_t afterTick = (event->flags & EVENT_FLAGS_OVERRUN) != 0 && wheel->clockTick > dueTick ?
+                        wheel->clockTick : dueTick;
+                uint64_t nextUs = nextWallUs(event, tickToWall(wheel, afterTick));
+
+                if (nextUs == UINT64_MAX)
+                {
+                    /* a cron schedule that never matches again */
+                    eventpool_release(&wheel->pool, event);
+                    continue;
+                }
+                event->baseTick = wallToTick(wheel, nextUs) - intervalTicks;
+            }
+            else if ((event->flags & EVENT_FLAG_OVERRUN_SKIP) != 0)
+            {
+                event->baseTick = dueTick + missed * intervalTicks;
+            }
+            else if ((event->flags & EVENT_FLAG_OVERRUN_ONCE) != 0 && wheel->clockTick > wheel->currentTick)
+            {
+                event->baseTick = wheel->clockTick;
+            }
+            else
+            {
+                event->baseTick = wheel->currentTick;
+            }
+
+            /* an atUs event is on the wall clock for its first run only */
+            if (!isWallPeriodic(event))
+            {
+                event->flags &= (uint8_t) ~EVENT_FLAG_WALL;
+            }
+
+            uint64_t nextTick = event->baseTick + event->intervalUs / wheel->stepUs;
+            remaining = nextTick > wheel->currentTick ? nextTick - wheel->currentTick : 1;
+        }
+
+        if (scheduleEvent(wheel, event, remaining) != 0)
+        {
+            eventpool_release(&wheel->pool, event);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Move the events producers pushed since the last drain into their slots.
+ * An event is due interval ms after the tick it was submitted at, so the
+ * ticks the wheel moved since then are taken off its first interval.
+ * Must be called with wheel->mutex held.
+ */
+static void drainInbox(TimeWheel_t *wheel)
+{
+    Event_t *event = __atomic_exchange_n(&wheel->inbox, NULL, __ATOMIC_ACQUIRE);
+    Event_t *fifo = NULL;
+
+    /* the inbox is a stack, restore submission order */
+    while (event != NULL)
+    {
+        Event_t *next = event->next;
+        event->next = fifo;
+        fifo = event;
+        event = next;
+    }
+
+    while (fifo != NULL)
+    {
+        Event_t *next = fifo->next;
+
+        if (fifo->state == EVENT_STATE_CANCELLED)
+        {
+            eventpool_release(&wheel->pool, fifo);
+            fifo = next;
+            continue;
+        }
+
+        if ((fifo->flags & EVENT_FLAG_WALL) != 0)
+        {
+            placeWallEvent(wheel, fifo);
+        }
+
+        /* the interval counts from the submission tick, which may be ahead of a sleeping loop */
+        uint64_t intervalTicks = fifo->intervalUs / wheel->stepUs;
+        if (fifo->baseTick + intervalTicks <= wheel->currentTick)
+        {
+            /* already overdue, fire on the next tick */
+            fifo->baseTick = wheel->currentTick + 1 - intervalTicks;
+        }
+
+        if (scheduleEvent(wheel, fifo, fifo->baseTick + intervalTicks - wheel->currentTick) != 0)
+        {
+            eventpool_release(&wheel->pool, fifo);
+        }
+
+        fifo = next;
+    }
+}
+
+/* ==================== Loop Thread Function ==================== */
+
+/*
+ * Wheel whose mutex the current thread holds while running callbacks inline.
+ * API calls made from those callbacks use it instead of locking again.
+ */
+static __thread TimeWheel_t *t_heldWheel = NULL;
+
+/* returns 1 if the mutex was taken here and has to be released by wheel_unlock() */
+static int wheel_lock(TimeWheel_t *wheel)
+{
+    if (t_heldWheel == wheel)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&wheel->mutex);
+    return 1;
+}
+
+static void wheel_unlock(TimeWheel_t *wheel, int locked)
+{
+    if (locked)
+    {
+        pthread_mutex_unlock(&wheel->mutex);
+    }
+}
+
+/* the same for event lists, whose loop threads run every callback with the list mutex held */
+static __thread EventList_t *t_heldList = NULL;
+
+static int eventlist_lock(EventList_t *eventList)
+{
+    if (t_heldList == eventList)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&eventList->mutex);
+    return 1;
+}
+
+static void eventlist_unlock(EventList_t *eventList, int locked)
+{
+    if (locked)
+    {
+        pthread_mutex_unlock(&eventList->mutex);
+    }
+}
+
+/* run a callback of an event list loop, returns -1 if it cancelled its own event, which is gone by then */
+static int eventlist_run(EventList_t *eventList, Event_t *event, uint64_t missed)
+{
+    eventList->firing = event;
+    runMissedCallback(event, missed);
+    if (eventList->firing != event)
+    {
+        return -1;
+    }
+
+    eventList->firing = NULL;
+    return 0;
+}
+
+static void tickToTimespec(const struct timespec *startTime, uint64_t tick, int64_t stepNs, struct timespec *ts)
+{
+    int64_t tickNs = (int64_t) tick * stepNs;
+
+    ts->tv_sec = startTime->tv_sec + tickNs / 1000000000LL;
+    ts->tv_nsec = startTime->tv_nsec + tickNs % 1000000000LL;
+
+    /* Normalize timespec */
+    if (ts->tv_nsec >= 1000000000LL)
+    {
+        ts->tv_sec += ts->tv_nsec / 1000000000LL;
+        ts->tv_nsec = ts->tv_nsec % 1000000000LL;
+    }
+}
+
+/* deadline moved spinUs earlier: where sleeping stops and spinning starts */
+static void spinStartTime(TimeWheel_t *wheel, const struct timespec *deadline, struct timespec *ts)
+{
+    int64_t ns = (int64_t) deadline->tv_sec * 1000000000LL + deadline->tv_nsec - (int64_t) wheel->spinUs * 1000LL;
+
+    ts->tv_sec = ns / 1000000000LL;
+    ts->tv_nsec = ns % 1000000000LL;
+}
+
+/*
+ * Poll the clock until deadline. Waking up from clock_nanosleep or a condvar
+ * takes tens of microseconds, a whole tick on a sub-millisecond wheel, so the
+ * last spinUs of every wait are spent here. New events and destroy end the
+ * spin early.
+ */
+static void spinUntil(TimeWheel_t *wheel, const struct timespec *deadline)
+{
+    int64_t deadlineNs = (int64_t) deadline->tv_sec * 1000000000LL + deadline->tv_nsec;
+    struct timespec now;
+
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((int64_t) now.tv_sec * 1000000000LL + now.tv_nsec < deadlineNs &&
+            __atomic_load_n(&wheel->inbox, __ATOMIC_RELAXED) == NULL && !__atomic_load_n(&wheel->stop, __ATOMIC_RELAXED));
+}
+
+/*
+ * Tick to advance to when the clock reads nowTick: all the way, or
+ * catchupTicks past currentTick if the wheel fell further behind than that,
+ * e.g. after a stall. The rest waits for the next clock tick, so a long
+ * backlog is spread over several wake-ups instead of one burst. Called with
+ * the mutex held.
+ */
+static uint64_t catchupTarget(TimeWheel_t *wheel, uint64_t nowTick)
+{
+    wheel->clockTick = nowTick;
+    if (wheel->catchupTicks != 0 && nowTick - wheel->currentTick > wheel->catchupTicks)
+    {
+        return wheel->currentTick + wheel->catchupTicks;
+    }
+
+    return nowTick;
+}
+
+/* tick the next wake-up is due at if the last advance left a backlog, 0 if it did not */
+static uint64_t catchupWakeTick(TimeWheel_t *wheel)
+{
+    return wheel->currentTick < wheel->clockTick ? wheel->clockTick + 1 : 0;
+}
+
+/*
+ * Tickless wait: sleep until the next occupied slot comes round. Producers
+ * that insert into an earlier slot signal wakeCond, and the deadline is
+ * computed again after every wake up.
+ */
+static void waitForNextSlot(TimeWheel_t *wheel, const struct timespec *startTime, int64_t stepNs)
+{
+    pthread_mutex_lock(&wheel->mutex);
+
+    /* new events must be placed before we know how long to sleep */
+    if (!wheel->stop && __atomic_load_n(&wheel->inbox, __ATOMIC_ACQUIRE) == NULL)
+    {
+        uint64_t ticks = ticksToNextSlot(wheel, wheel->timePos, UINT64_MAX);
+        uint64_t cascadeTicks = ticksToCascade(wheel);
+
+        if (cascadeTicks < ticks)
+        {
+            /* wake up in time to move the next overflow event into the wheel */
+            ticks = cascadeTicks;
+        }
+
+        if (ticks == UINT64_MAX)
+        {
+            wheel->wakeTick = UINT64_MAX;
+            pthread_cond_wait(&wheel->wakeCond, &wheel->mutex);
+        }
+        else
+        {
+            struct timespec wakeTime, sleepTime;
+
+            wheel->wakeTick = wheel->currentTick + ticks;
+            if (wheel->wakeTick < catchupWakeTick(wheel))
+            {
+                /* behind the clock: the rest of the backlog on the next tick */
+                wheel->wakeTick = catchupWakeTick(wheel);
+            }
+            tickToTimespec(startTime, wheel->wakeTick, stepNs, &wakeTime);
+            spinStartTime(wheel, &wakeTime, &sleepTime);
+            if (pthread_cond_timedwait(&wheel->wakeCond, &wheel->mutex, &sleepTime) == ETIMEDOUT && wheel->spinUs != 0)
+            {
+                /* spin without the mutex so producers are not held up */
+                pthread_mutex_unlock(&wheel->mutex);
+                spinUntil(wheel, &wakeTime);
+                return;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+/*
+ * Process every occupied slot up to targetTick, called with the mutex held.
+ * The bitmap lets us jump straight to the next occupied slot, and the
+ * position is only ever changed under the mutex so producers always insert
+ * relative to the slot the wheel is really at.
+ */
+static void advanceWheel(TimeWheel_t *wheel, uint64_t targetTick)
+{
+    uint64_t remaining = targetTick - wheel->currentTick; //how many slots passed
+    while (remaining > 0 && !__atomic_load_n(&wheel->stop, __ATOMIC_ACQUIRE))
+    {
+        /* overflow events that came within one period go to their slots before we jump over them */
+        cascadeOverflow(wheel);
+
+        uint64_t ticks = ticksToNextSlot(wheel, wheel->timePos, remaining);
+        uint64_t cascadeTicks = ticksToCascade(wheel);
+        if (cascadeTicks < ticks && cascadeTicks <= remaining)
+        {
+            wheel->timePos = advanceTimePos(wheel, wheel->timePos, cascadeTicks);
+            __atomic_store_n(&wheel->currentTick, wheel->currentTick + cascadeTicks, __ATOMIC_RELEASE);
+            remaining -= cascadeTicks;
+            continue;
+        }
+
+        if (ticks > remaining)
+        {
+            wheel->timePos = advanceTimePos(wheel, wheel->timePos, remaining);
+            __atomic_store_n(&wheel->currentTick, wheel->currentTick + remaining, __ATOMIC_RELEASE);
+            break;
+        }
+
+        /* currentTick always matches timePos, touch and inbox ticks are compared against it */
+        wheel->timePos = advanceTimePos(wheel, wheel->timePos, ticks);
+        __atomic_store_n(&wheel->currentTick, wheel->currentTick + ticks, __ATOMIC_RELEASE);
+        remaining -= ticks;
+        processEvent(wheel, slotIndexForPos(wheel, wheel->timePos));
+
+        /* events the callbacks created may be due before we get to targetTick */
+        if (__atomic_load_n(&wheel->inbox, __ATOMIC_RELAXED) != NULL)
+        {
+            drainInbox(wheel);
+        }
+    }
+    cascadeOverflow(wheel);
+}
+
+/* arm the timerfd for tick, UINT64_MAX disarms it, called with the mutex held */
+static void timerfdArm(TimeWheel_t *wheel, uint64_t tick)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    if (tick != UINT64_MAX)
+    {
+        tickToTimespec(&wheel->startTime, tick, (int64_t) wheel->stepUs * 1000LL, &spec.it_value);
+    }
+
+    __atomic_store_n(&wheel->wakeTick, tick, __ATOMIC_SEQ_CST);
+    timerfd_settime(wheel->timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/*
+ * Point the timerfd at the next occupied slot, or the next cascade, after a
+ * process call. A producer that read the old wakeTick did not arm the fd for
+ * its event, but pushed it before wakeTick was stored, so it shows up in the
+ * inbox check here.
+ */
+static void timerfdRearm(TimeWheel_t *wheel)
+{
+    for (;;)
+    {
+        uint64_t ticks = ticksToNextSlot(wheel, wheel->timePos, UINT64_MAX);
+        uint64_t cascadeTicks = ticksToCascade(wheel);
+
+        if (cascadeTicks < ticks)
+        {
+            ticks = cascadeTicks;
+        }
+
+        uint64_t tick = ticks == UINT64_MAX ? UINT64_MAX : wheel->currentTick + ticks;
+        if (tick < catchupWakeTick(wheel))
+        {
+            /* behind the clock: the rest of the backlog on the next tick, not straight away */
+            tick = catchupWakeTick(wheel);
+        }
+        __atomic_store_n(&wheel->wakeTick, tick, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&wheel->inbox, __ATOMIC_SEQ_CST) == NULL)
+        {
+            timerfdArm(wheel, tick);
+            return;
+        }
+
+        drainInbox(wheel);
+    }
+}
+
+/* a producer added or moved an event due at dueTick, make sure the owner's poll returns in time */
+static void timerfdWakeFor(TimeWheel_t *wheel, uint64_t dueTick)
+{
+    /* pairs with the wakeTick store and inbox load in timerfdRearm() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (dueTick >= __atomic_load_n(&wheel->wakeTick, __ATOMIC_SEQ_CST))
+    {
+        return;
+    }
+
+    int locked = wheel_lock(wheel);
+    if (dueTick < wheel->wakeTick)
+    {
+        timerfdArm(wheel, dueTick);
+    }
+    wheel_unlock(wheel, locked);
+}
+
+static int checkThreadConfig(const TimeWheelThreadConfig_t *config)
+{
+    if (config == NULL || config->policy == SCHED_OTHER)
+    {
+        return 0;
+    }
+
+    if ((config->policy != SCHED_FIFO && config->policy != SCHED_RR) ||
+            config->priority < sched_get_priority_min(config->policy) || config->priority > sched_get_priority_max(config->policy))
+    {
+        ERROR_TIME_LINE("invalid thread scheduling: policy %d priority %d", config->policy, config->priority);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int applyThreadConfig(pthread_attr_t *attr, const TimeWheelThreadConfig_t *config, int cpu, int realtime)
+{
+    cpu_set_t cpuSet;
+    int pinned = 0;
+    int ret;
+
+    CPU_ZERO(&cpuSet);
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+    {
+        CPU_SET(cpu, &cpuSet);
+        pinned = 1;
+    }
+
+    if (config != NULL)
+    {
+        for (uint32_t i = 0; i < TIMEWHEEL_CPU_WORDS; i++)
+        {
+            for (uint64_t bits = config->cpus[i]; bits != 0; bits &= bits - 1)
+            {
+                CPU_SET(i * 64 + __builtin_ctzll(bits), &cpuSet);
+                pinned = 1;
+            }
+        }
+
+        if (config->stackSize != 0 && (ret = pthread_attr_setstacksize(attr, config->stackSize)) != 0)
+        {
+            return ret;
+        }
+
+        if (realtime && config->policy != SCHED_OTHER)
+        {
+            struct sched_param param = { .sched_priority = config->priority };
+
+            pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+            if ((ret = pthread_attr_setschedpolicy(attr, config->policy)) != 0 || (ret = pthread_attr_setschedparam(attr, &param)) != 0)
+            {
+                return ret;
+            }
+        }
+    }
+
+    return pinned ? pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &cpuSet) : 0;
+}
+
+/*
+ * Start a loop thread with the configured scheduling, CPUs and stack size.
+ * A real-time policy needs CAP_SYS_NICE or RLIMIT_RTPRIO; without either
+ * the thread runs with the default policy instead of not at all.
+ */
+static int createLoopThread(pthread_t *thread, const TimeWheelThreadConfig_t *config, int cpu, void *(*loop)(void*), void *arg)
+{
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    int ret = applyThreadConfig(&attr, config, cpu, 1);
+    if (ret == 0)
+    {
+        ret = pthread_create(thread, &attr, loop, arg);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (ret == EPERM && config != NULL && config->policy != SCHED_OTHER)
+    {
+        ERROR_TIME_LINE("no permission for scheduling policy %d, the loop thread keeps the default policy", config->policy);
+        pthread_attr_init(&attr);
+        ret = applyThreadConfig(&attr, config, cpu, 0);
+        if (ret == 0)
+        {
+            ret = pthread_create(thread, &attr, loop, arg);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    return ret;
+}
+
+/* ==================== Clock Set Watcher ==================== */
+
+/*
+ * One thread per process blocks on a CLOCK_REALTIME timerfd armed with
+ * TFD_TIMER_CANCEL_ON_SET, which the kernel cancels whenever the clock is
+ * set. It then wakes the tickless and timerfd wheels holding wall-clock
+ * events, which re-place them in syncWallClock(). Tick wheels look every
+ * tick anyway. Lock order is the watcher list, then a wheel's mutex.
+ */
+static struct {
+    pthread_mutex_t mutex;
+    TimeWheel_t *wheels; /* linked through watchNext */
+} g_clockWatch = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+static pthread_once_t g_clockWatchOnce = PTHREAD_ONCE_INIT;
+
+static void clockWatchWakeAll(void)
+{
+    pthread_mutex_lock(&g_clockWatch.mutex);
+    for (TimeWheel_t *wheel = g_clockWatch.wheels; wheel != NULL; wheel = wheel->watchNext)
+    {
+        if (__atomic_load_n(&wheel->wallCount, __ATOMIC_RELAXED) == 0)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&wheel->mutex);
+        if (wheel->mode == TIMEWHEEL_MODE_TIMERFD)
+        {
+            /* a tick already passed, the fd is readable at once */
+            timerfdArm(wheel, wheel->currentTick);
+        }
+        else
+        {
+            pthread_cond_signal(&wheel->wakeCond);
+        }
+        pthread_mutex_unlock(&wheel->mutex);
+    }
+    pthread_mutex_unlock(&g_clockWatch.mutex);
+}
+
+static void* clockWatchThread(void *arg)
+{
+    int fd = (int) (intptr_t) arg;
+
+    for (;;)
+    {
+        struct itimerspec spec;
+        uint64_t expirations;
+
+        /* the expiry does not matter, only the cancellation, so a year out */
+        memset(&spec, 0, sizeof(spec));
+        clock_gettime(CLOCK_REALTIME, &spec.it_value);
+        spec.it_value.tv_sec += 365 * 24 * 3600;
+        if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) != 0)
+        {
+            break;
+        }
+
+        if (read(fd, &expirations, sizeof(expirations)) < 0)
+        {
+            if (errno == ECANCELED)
+            {
+                clockWatchWakeAll();
+            }
+            else if (errno != EINTR)
+            {
+                break;
+            }
+        }
+    }
+
+    ERROR_TIME_LINE("clock set watcher stopped: %s, wall-clock events follow clock changes when their wheel next wakes",
+            strerror(errno));
+    close(fd);
+
+    return NULL;
+}
+
+static void clockWatchStart(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+
+    if (fd < 0)
+    {
+        ERROR_TIME_LINE("failed to create clock set timerfd: %s", strerror(errno));
+        return;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, clockWatchThread, (void*) (intptr_t) fd) != 0)
+    {
+        ERROR_TIME_LINE("failed to create clock set watcher");
+        close(fd);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/* a tickless or timerfd wheel is woken when the clock is set, the thread starts with the first wall-clock event */
+static void clockWatchAdd(TimeWheel_t *wheel)
+{
+    pthread_mutex_lock(&g_clockWatch.mutex);
+    wheel->watchNext = g_clockWatch.wheels;
+    g_clockWatch.wheels = wheel;
+    pthread_mutex_unlock(&g_clockWatch.mutex);
+}
+
+static void clockWatchRemove(TimeWheel_t *wheel)
+{
+    pthread_mutex_lock(&g_clockWatch.mutex);
+    for (TimeWheel_t **link = &g_clockWatch.wheels; *link != NULL; link = &(*link)->watchNext)
+    {
+        if (*link == wheel)
+        {
+            *link = wheel->watchNext;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_clockWatch.mutex);
+}
+
+static void* loopForInterval(void *arg)
+{
+    if (arg == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return NULL;
+    }
+
+    TimeWheel_t *wheel = (TimeWheel_t*) arg;
+
+    /* Use CLOCK_MONOTONIC for steady time measurement */
+    const struct timespec startTime = wheel->startTime;
+    struct timespec nextTickTime, sleepTime;
+
+    const int64_t stepNs = (int64_t) wheel->stepUs * 1000LL; /* nanoseconds per step */
+
+    if (wheel->stepUs < 1000)
+    {
+        /* the default 50us timer slack is most of a sub-millisecond tick */
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    }
+
+    while (!__atomic_load_n(&wheel->stop, __ATOMIC_ACQUIRE))
+    {
+        if (wheel->mode == TIMEWHEEL_MODE_TICKLESS)
+        {
+            waitForNextSlot(wheel, &startTime, stepNs);
+        }
+        else
+        {
+            /* Calculate next tick time based on anchor and processed ticks, or on the clock while catching up */
+            uint64_t nextTick = catchupWakeTick(wheel);
+            tickToTimespec(&startTime, nextTick != 0 ? nextTick : wheel->currentTick + 1, stepNs, &nextTickTime);
+
+            /* Sleep until next tick time (absolute time), spinning through the last spinUs */
+            spinStartTime(wheel, &nextTickTime, &sleepTime);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sleepTime, NULL) == EINTR)
+            {
+                /* Retry if interrupted */
+            }
+
+            if (wheel->spinUs != 0)
+            {
+                spinUntil(wheel, &nextTickTime);
+            }
+        }
+
+        /* Get current time to compute elapsed ticks */
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        /* Calculate elapsed time in nanoseconds */
+        int64_t elapsedNs = (int64_t) (now.tv_sec - startTime.tv_sec) * 1000000000LL +
+                (int64_t) (now.tv_nsec - startTime.tv_nsec);
+
+        if (elapsedNs < 0)
+        {
+            continue;
+        }
+
+        uint64_t ticksSinceStart = (uint64_t) (elapsedNs / stepNs);
+
+        /* Process every occupied slot passed since the last wake up */
+        uint64_t wakeNs = (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+
+        pthread_mutex_lock(&wheel->mutex);
+        t_heldWheel = wheel;
+        uint64_t lockNs = getMonotonicNs();
+
+        syncWallClock(wheel);
+        drainInbox(wheel);
+
+        if (ticksSinceStart <= wheel->currentTick)
+        {
+            /* nothing new to process, e.g. woken early by a producer */
+            histogram_record(&wheel->latency.lockHold, getMonotonicNs() - lockNs);
+            t_heldWheel = NULL;
+            pthread_mutex_unlock(&wheel->mutex);
+            continue;
+        }
+
+        advanceWheel(wheel, catchupTarget(wheel, ticksSinceStart));
+
+        histogram_record(&wheel->latency.lockHold, getMonotonicNs() - lockNs);
+        t_heldWheel = NULL;
+        pthread_mutex_unlock(&wheel->mutex);
+
+        /* hand the pooled callbacks over only after producers can get the mutex again */
+        workerpool_dispatch(&wheel->workers);
+        histogram_record(&wheel->latency.tick, getMonotonicNs() - wakeNs);
+    }
+
+    return NULL;
+}
+
+int compareTimeSpec(struct timespec *t1, struct timespec *t2)
+{
+    if (t1->tv_sec < t2->tv_sec || (t1->tv_sec == t2->tv_sec && t1->tv_nsec < t2->tv_nsec))
+    {
+        return -1;
+    }
+
+    if (t1->tv_sec == t2->tv_sec && t1->tv_nsec == t2->tv_nsec)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+static uint64_t calcNextRunTime(uint64_t startMs, uint64_t intervalMs, uint64_t nowMs)
+{
+    if (startMs > nowMs)
+    {
+        return startMs;
+    }
+
+    if (startMs == nowMs)
+    {
+        return startMs + intervalMs;
+    }
+
+    uint64_t count = (nowMs - startMs) / intervalMs;
+    uint64_t ms = startMs + count * intervalMs + intervalMs;
+
+    return ms;
+}
+
+static void* threadLoopNoTimeWheel(void *arg)
+{
+    EventList_t *pEventList = (EventList_t*) arg;
+    if (pEventList == NULL)
+    {
+        return NULL;
+    }
+
+    Event_t *event = NULL;
+    struct timespec now;
+    struct timespec wakeTime;
+    arg_t *pArg = NULL;
+    uint64_t nowMs = 0;
+
+    pthread_mutex_lock(&pEventList->mutex);
+    t_heldList = pEventList;
+    while (!pEventList->stop)
+    {
+        clock_gettime(CLOCK_REALTIME, &now);
+        nowMs = get_ms_by_timesp(&now);
+
+        /* run what is due and find the earliest next run time on the same walk */
+        uint64_t earliestMs = UINT64_MAX;
+        event = pEventList->head;
+        while (event)
+        {
+            int cancelled = 0;
+
+            pArg = (arg_t*) event->arg;
+            if (nowMs >= pArg->nextTimemMs && (event->flags & EVENT_FLAGS_OVERRUN) == 0)
+            {
+                /* TIMEWHEEL_OVERRUN_FIRE_ALL: one run per period the list fell behind */
+                while (nowMs >= pArg->nextTimemMs && (cancelled = eventlist_run(pEventList, event, 0)) == 0)
+                {
+                    pArg->nextTimemMs += pArg->interval;
+                }
+            }
+            else if (nowMs >= pArg->nextTimemMs)
+            {
+                cancelled = eventlist_run(pEventList, event, missedPeriods(pArg->nextTimemMs, pArg->interval, nowMs));
+                if (cancelled == 0)
+                {
+                    pArg->nextTimemMs = (event->flags & EVENT_FLAG_OVERRUN_ONCE) != 0 ? nowMs + pArg->interval :
+                            calcNextRunTime(pArg->startTimeMs, pArg->interval, nowMs);
+                }
+            }
+
+            if (cancelled != 0)
+            {
+                /* the event and its arg may be gone, start the walk over, what already ran is not due again */
+                earliestMs = UINT64_MAX;
+                event = pEventList->head;
+                continue;
+            }
+
+            if (pArg->nextTimemMs < earliestMs)
+            {
+                earliestMs = pArg->nextTimemMs;
+            }
+
+            event = event->next;
+        }
+
+        /* sleep until the earliest event is due, eventList_addEvent() wakes us for earlier ones */
+        pEventList->wakeMs = earliestMs;
+        if (earliestMs == UINT64_MAX)
+        {
+            pthread_cond_wait(&pEventList->wakeCond, &pEventList->mutex);
+        }
+        else
+        {
+            wakeTime.tv_sec = (time_t) (earliestMs / 1000);
+            wakeTime.tv_nsec = (long) (earliestMs % 1000) * 1000000L;
+            pthread_cond_timedwait(&pEventList->wakeCond, &pEventList->mutex, &wakeTime);
+        }
+    }
+    t_heldList = NULL;
+    pthread_mutex_unlock(&pEventList->mutex);
+
+    return NULL;
+}
+
+static void* threadLoopHeap(void *arg)
+{
+    EventList_t *pEventList = (EventList_t*) arg;
+    if (pEventList == NULL)
+    {
+        return NULL;
+    }
+
+    EventHeap_t *heap = pEventList->heap;
+    struct timespec wakeTime;
+
+    pthread_mutex_lock(&pEventList->mutex);
+    t_heldList = pEventList;
+    while (!pEventList->stop)
+    {
+        uint64_t nowMs = getMonotonicMs();
+
+        /* only the due events are touched, each costs one sift down */
+        while (heap->size > 0 && heap->entries[0].deadline <= nowMs)
+        {
+            Event_t *event = heap->entries[0].event;
+            uint64_t deadline = heap->entries[0].deadline;
+            uint64_t interval = event->intervalUs / 1000;
+            uint64_t missed = (event->flags & EVENT_FLAGS_OVERRUN) != 0 ? missedPeriods(deadline, interval, nowMs) : 0;
+
+            if (eventlist_run(pEventList, event, missed) != 0)
+            {
+                continue;
+            }
+
+            /* the callback may have added or cancelled events and moved this one off the root */
+            uint32_t index = eventCold(event)->heapIndex;
+
+            /* FIRE_ALL stays due and comes straight back to the root, SKIP keeps the original schedule */
+            if ((event->flags & EVENT_FLAG_OVERRUN_ONCE) != 0)
+            {
+                heap->entries[index].deadline = nowMs + interval;
+            }
+            else
+            {
+                heap->entries[index].deadline = deadline + (missed + 1) * interval;
+            }
+            eventheap_sift_down(heap, index);
+        }
+
+        pEventList->wakeMs = heap->size > 0 ? heap->entries[0].deadline : UINT64_MAX;
+        if (pEventList->wakeMs == UINT64_MAX)
+        {
+            pthread_cond_wait(&pEventList->wakeCond, &pEventList->mutex);
+        }
+        else
+        {
+            wakeTime.tv_sec = (time_t) (pEventList->wakeMs / 1000);
+            wakeTime.tv_nsec = (long) (pEventList->wakeMs % 1000) * 1000000L;
+            pthread_cond_timedwait(&pEventList->wakeCond, &pEventList->mutex, &wakeTime);
+        }
+    }
+    t_heldList = NULL;
+    pthread_mutex_unlock(&pEventList->mutex);
+
+    return NULL;
+}
+
+/* ==================== Public API Implementation ==================== */
+
+TimeWheel_t* timewheel_create(uint32_t steps, uint32_t maxMin)
+{
+    TimeWheelConfig_t config;
+
+    timewheel_config_default(&config, steps, maxMin);
+    return timewheel_create_ex(&config);
+}
+
+TimeWheel_t* timewheel_create_ex(const TimeWheelConfig_t *config)
+{
+    TimeWheel_t *wheel = (TimeWheel_t*) malloc(sizeof(TimeWheel_t));
+    if (wheel == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for timewheel");
+        return NULL;
+    }
+
+    memset(wheel, 0, sizeof(TimeWheel_t));
+
+    if (timewheel_init_ex(wheel, config) != 0)
+    {
+        free(wheel);
+        return NULL;
+    }
+
+    return wheel;
+}
+
+void timewheel_destroy(TimeWheel_t *wheel)
+{
+    if (wheel == NULL)
+    {
+        return;
+    }
+
+    /* the clock set watcher must be done with the wheel before its fd is closed */
+    clockWatchRemove(wheel);
+
+    /* Stop and join the loop thread, the flag is seen even while it catches up */
+    __atomic_store_n(&wheel->stop, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&wheel->mutex);
+    pthread_cond_signal(&wheel->wakeCond);
+    pthread_mutex_unlock(&wheel->mutex);
+    if (wheel->mode == TIMEWHEEL_MODE_TIMERFD)
+    {
+        close(wheel->timerFd);
+    }
+    else if (wheel->mode != TIMEWHEEL_MODE_MANUAL)
+    {
+        pthread_join(wheel->loopThread, NULL);
+    }
+
+    /* Runs the callbacks already handed over, then joins the workers */
+    workerpool_destroy(&wheel->workers);
+
+    /* Events still owned by the wheel give their arguments back */
+    for (uint32_t i = 0; i < wheel->pool.chunkCount; i++)
+    {
+        for (uint32_t j = 0; j < EVENT_POOL_CHUNK_SIZE; j++)
+        {
+            Event_t *event = &wheel->pool.chunks[i][j];
+            if (event->state != EVENT_STATE_FREE && eventCold(event)->freeArgCb != NULL)
+            {
+                eventCold(event)->freeArgCb(event->arg);
+            }
+        }
+    }
+
+    /* Events live in the pool chunks, so dropping the pool releases all of them */
+    free(wheel->eventSlotArray.slots);
+    free(wheel->levelBitmap[0].words);
+    free(wheel->overflow.base);
+    free(wheel->wallEvents);
+    eventpool_destroy(&wheel->pool);
+
+    pthread_cond_destroy(&wheel->wakeCond);
+    pthread_mutex_destroy(&wheel->mutex);
+    free(wheel);
+}
+
+void timewheel_config_default(TimeWheelConfig_t *config, uint32_t steps, uint32_t maxMin)
+{
+    memset(config, 0, sizeof(TimeWheelConfig_t));
+    config->steps = steps;
+    config->maxMin = maxMin;
+    config->mode = TIMEWHEEL_MODE_TICK;
+    config->cpu = -1;
+}
+
+int timewheel_init(TimeWheel_t *wheel, uint32_t steps, uint32_t maxMin)
+{
+    TimeWheelConfig_t config;
+
+    timewheel_config_default(&config, steps, maxMin);
+    return timewheel_init_ex(wheel, &config);
+}
+
+int timewheel_init_ex(TimeWheel_t *wheel, const TimeWheelConfig_t *config)
+{
+    if (wheel == NULL || config == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    uint32_t stepUs = config->stepUs != 0 ? config->stepUs : config->steps * 1000;
+    if (stepUs == 0 || US_PER_SEC % stepUs != 0)
+    {
+        ERROR_TIME_LINE("invalid steps: must be a factor of 1000 ms or 1000000 us");
+        return -1;
+    }
+
+    if (config->maxMin == 0)
+    {
+        ERROR_TIME_LINE("invalid maxMin: must be at least 1");
+        return -1;
+    }
+
+    if (checkThreadConfig(&config->thread) != 0)
+    {
+        return -1;
+    }
+
+    wheel->stepUs = stepUs;
+    wheel->spinUs = config->spinUs;
+    wheel->catchupTicks = config->catchupTicks;
+    wheel->firstLevelCount = (uint32_t) (US_PER_SEC / stepUs);
+    wheel->secondLevelCount = 60;
+    wheel->thirdLevelCount = config->maxMin;
+    wheel->increaseId = 0;
+    wheel->mode = config->mode;
+    wheel->currentTick = 0;
+    wheel->wakeTick = UINT64_MAX;
+    wheel->timerFd = -1;
+    wheel->stop = 0;
+    wheel->inbox = NULL;
+    wheel->firedCount = 0;
+    wheel->slotsVisited = 0;
+    wheel->missedCount = 0;
+    wheel->clockTick = 0;
+    wheel->wallEvents = NULL;
+    wheel->wallCount = 0;
+    wheel->wallCapacity = 0;
+    wheel->watchNext = NULL;
+    memset(&wheel->overflow, 0, sizeof(EventHeap_t));
+    memset(&wheel->latency, 0, sizeof(TimeWheelLatency_t));
+
+    /* Allocate event slot array */
+    wheel->eventSlotArray.size = wheel->firstLevelCount + wheel->secondLevelCount + wheel->thirdLevelCount;
+    wheel->eventSlotArray.slots = (WheelSlot_t*) malloc(sizeof(WheelSlot_t) * wheel->eventSlotArray.size);
+    if (wheel->eventSlotArray.slots == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for event slots");
+        return -1;
+    }
+
+    /* Initialize all slots empty */
+    for (uint32_t i = 0; i < wheel->eventSlotArray.size; i++)
+    {
+        wheel->eventSlotArray.slots[i].head = EVENT_INDEX_NONE;
+        wheel->eventSlotArray.slots[i].tail = EVENT_INDEX_NONE;
+    }
+
+    /* One allocation holds the occupancy bitmaps of all three levels */
+    uint32_t levelSize[3] = { wheel->firstLevelCount, wheel->secondLevelCount, wheel->thirdLevelCount };
+    uint32_t words = 0;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        words += (levelSize[i] + 63) / 64;
+    }
+
+    uint64_t *bitmapWords = (uint64_t*) calloc(words, sizeof(uint64_t));
+    if (bitmapWords == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for slot bitmap");
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        wheel->levelBitmap[i].words = bitmapWords;
+        wheel->levelBitmap[i].size = levelSize[i];
+        bitmapWords += (levelSize[i] + 63) / 64;
+    }
+
+    /* Initialize mutex */
+    if (pthread_mutex_init(&wheel->mutex, NULL) != 0)
+    {
+        ERROR_TIME_LINE("failed to initialize mutex");
+        free(wheel->levelBitmap[0].words);
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+
+    /* The tickless loop waits on CLOCK_MONOTONIC deadlines */
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&wheel->wakeCond, &condAttr) != 0)
+    {
+        ERROR_TIME_LINE("failed to initialize condition variable");
+        pthread_condattr_destroy(&condAttr);
+        pthread_mutex_destroy(&wheel->mutex);
+        free(wheel->levelBitmap[0].words);
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+    pthread_condattr_destroy(&condAttr);
+
+    if (eventpool_init(&wheel->pool) != 0)
+    {
+        ERROR_TIME_LINE("failed to initialize event pool");
+        pthread_cond_destroy(&wheel->wakeCond);
+        pthread_mutex_destroy(&wheel->mutex);
+        free(wheel->levelBitmap[0].words);
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+
+    /* the slots are already written above, the event pages are touched as the pool grows */
+    if (config->prefaultEvents != 0 && eventpool_reserve(&wheel->pool, config->prefaultEvents) != 0)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for %u events", config->prefaultEvents);
+        eventpool_destroy(&wheel->pool);
+        pthread_cond_destroy(&wheel->wakeCond);
+        pthread_mutex_destroy(&wheel->mutex);
+        free(wheel->levelBitmap[0].words);
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+
+    if (workerpool_init(&wheel->workers, config->workerCount, &wheel->pool, &wheel->latency) != 0)
+    {
+        ERROR_TIME_LINE("failed to start %u callback workers", config->workerCount);
+        eventpool_destroy(&wheel->pool);
+        pthread_cond_destroy(&wheel->wakeCond);
+        pthread_mutex_destroy(&wheel->mutex);
+        free(wheel->levelBitmap[0].words);
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+
+    /* what the wheel allocated so far stays resident, and so does whatever it allocates later, loop stack included */
+    if (config->lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        ERROR_TIME_LINE("mlockall error: %s, the wheel may still page fault", strerror(errno));
+    }
+
+    /* Create loop thread, tick 0 is now */
+    clock_gettime(CLOCK_MONOTONIC, &wheel->startTime);
+    wheel->realStartUs = readRealStartUs(wheel);
+    if (wheel->mode == TIMEWHEEL_MODE_MANUAL)
+    {
+        /* driven by timewheel_advance() */
+        return 0;
+    }
+
+    if (wheel->mode == TIMEWHEEL_MODE_TIMERFD)
+    {
+        /* driven by the caller's event loop, disarmed until the first event */
+        wheel->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (wheel->timerFd < 0)
+        {
+            ERROR_TIME_LINE("timerfd_create error: %s", strerror(errno));
+            workerpool_destroy(&wheel->workers);
+            eventpool_destroy(&wheel->pool);
+            pthread_cond_destroy(&wheel->wakeCond);
+            pthread_mutex_destroy(&wheel->mutex);
+            free(wheel->levelBitmap[0].words);
+            free(wheel->eventSlotArray.slots);
+            return -1;
+        }
+        clockWatchAdd(wheel);
+        return 0;
+    }
+
+    int ret = createLoopThread(&wheel->loopThread, &config->thread, config->cpu, loopForInterval, wheel);
+    if (ret != 0)
+    {
+        ERROR_TIME_LINE("create thread error: %s", strerror(ret));
+        workerpool_destroy(&wheel->workers);
+        eventpool_destroy(&wheel->pool);
+        pthread_cond_destroy(&wheel->wakeCond);
+        pthread_mutex_destroy(&wheel->mutex);
+        free(wheel->levelBitmap[0].words);
+        free(wheel->eventSlotArray.slots);
+        return -1;
+    }
+
+    if (wheel->mode == TIMEWHEEL_MODE_TICKLESS)
+    {
+        clockWatchAdd(wheel);
+    }
+
+    return 0;
+}
+
+void timewheel_event_spec_default(TimeWheelEventSpec_t *spec, uint32_t interval, EventCallback_t callback, void *arg)
+{
+    memset(spec, 0, sizeof(TimeWheelEventSpec_t));
+    spec->interval = interval;
+    spec->cb = callback;
+    spec->arg = arg;
+}
+
+int timewheel_create_event(TimeWheel_t *wheel, uint32_t interval, EventCallback_t callback, void *arg)
+{
+    TimeWheelEventSpec_t spec;
+
+    timewheel_event_spec_default(&spec, interval, callback, arg);
+    return timewheel_create_event_ex(wheel, &spec, NULL);
+}
+
+/* interval rules shared by create and modify */
+static int checkInterval(TimeWheel_t *wheel, uint64_t intervalUs)
+{
+    /* intervals beyond one wheel period wait in the overflow heap */
+    if (intervalUs < wheel->stepUs || intervalUs % wheel->stepUs != 0)
+    {
+        ERROR_TIME_LINE("invalid interval: %llu us", (unsigned long long) intervalUs);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* a cron schedule has no interval, nor needs a one-shot atUs event one: both step the wheel a tick at a time */
+static uint64_t specIntervalUs(TimeWheel_t *wheel, const TimeWheelEventSpec_t *spec)
+{
+    uint64_t intervalUs = spec->intervalUs != 0 ? spec->intervalUs : (uint64_t) spec->interval * 1000;
+
+    if (spec->cron != NULL || (intervalUs == 0 && spec->atUs != 0 && spec->repeat == 1))
+    {
+        return wheel->stepUs;
+    }
+
+    return intervalUs;
+}
+
+static int checkCron(TimeWheel_t *wheel, const TimeWheelCron_t *cron)
+{
+    uint64_t nextUs;
+
+    if (cron != NULL && timewheel_cron_next(cron, wallNowUs(wheel), &nextUs) != 0)
+    {
+        ERROR_TIME_LINE("invalid cron schedule: it never matches");
+        return -1;
+    }
+
+    return 0;
+}
+
+static TimeWheelHandle_t makeHandle(const Event_t *event)
+{
+    return ((TimeWheelHandle_t) event->generation << 32) | event->index;
+}
+
+/* live event behind a handle, or NULL if it was cancelled or has finished. Called with wheel->mutex held */
+static Event_t* lookupHandle(TimeWheel_t *wheel, TimeWheelHandle_t handle)
+{
+    Event_t *event = eventpool_get(&wheel->pool, (uint32_t) handle);
+
+    if (event == NULL || __atomic_load_n(&event->generation, __ATOMIC_ACQUIRE) != ((handle >> 32) & 0xFFFF) ||
+            event->state == EVENT_STATE_FREE || event->state == EVENT_STATE_CANCELLED)
+    {
+        return NULL;
+    }
+
+    return event;
+}
+
+/* fill in a freshly allocated event, due intervalUs after nowTick */
+static void prepareEvent(TimeWheel_t *wheel, Event_t *event, const TimeWheelEventSpec_t *spec, uint64_t intervalUs, uint64_t nowTick)
+{
+    /* index, generation and the unlinked slot indices belong to the pool slot and survive reuse */
+    EventCold_t *cold = eventCold(event);
+    event->intervalUs = intervalUs;
+    event->cb = spec->cb;
+    event->arg = spec->arg;
+    event->flags = (uint8_t) ((spec->flags & ~EVENT_FLAGS_INTERNAL) | overrunFlags(spec->overrun));
+    event->touch = 0;
+    event->state = EVENT_STATE_INBOX;
+    event->baseTick = nowTick;
+    cold->repeat = spec->repeat;
+    cold->freeArgCb = spec->freeArgCb;
+    cold->lateness = spec->lateness;
+    cold->cron = spec->cron;
+    cold->refs = 1;
+
+    /* slack shorter than a tick changes nothing */
+    uint64_t slackTicks = spec->slackUs / wheel->stepUs;
+    cold->slackTicks = slackTicks > UINT32_MAX ? UINT32_MAX : (uint32_t) slackTicks;
+    if (cold->slackTicks != 0)
+    {
+        event->flags |= EVENT_FLAG_SLACK;
+    }
+
+    if (spec->cron != NULL || spec->atUs != 0 || (spec->flags & TIMEWHEEL_EVENT_WALLCLOCK) != 0)
+    {
+        /* the first due time on CLOCK_REALTIME, placed on its tick by drainInbox() */
+        uint64_t nowUs = wallNowUs(wheel);
+        uint64_t afterUs = spec->atUs > nowUs ? spec->atUs - 1 : nowUs;
+
+        event->touch = isWallPeriodic(event) ? nextWallUs(event, afterUs) : spec->atUs;
+        event->flags |= EVENT_FLAG_WALL;
+        if (wheel->mode == TIMEWHEEL_MODE_TICKLESS || wheel->mode == TIMEWHEEL_MODE_TIMERFD)
+        {
+            pthread_once(&g_clockWatchOnce, clockWatchStart);
+        }
+    }
+}
+
+/* tick a freshly prepared event is first due at, read before it is submitted */
+static uint64_t firstDueTick(TimeWheel_t *wheel, const Event_t *event)
+{
+    if ((event->flags & EVENT_FLAG_WALL) != 0)
+    {
+        return wallToTick(wheel, event->touch);
+    }
+
+    return event->baseTick + event->intervalUs / wheel->stepUs;
+}
+
+/*
+ * Push the chain top..bottom to the inbox with one CAS, the loop thread
+ * inserts the events into their slots on the next tick and restores the
+ * order they were created in. dueTick is the earliest of them.
+ */
+static void submitEvents(TimeWheel_t *wheel, Event_t *top, Event_t *bottom, uint64_t dueTick)
+{
+    Event_t *head = __atomic_load_n(&wheel->inbox, __ATOMIC_RELAXED);
+    do
+    {
+        bottom->next = head;
+    } while (!__atomic_compare_exchange_n(&wheel->inbox, &head, top, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (head == NULL && wheel->mode == TIMEWHEEL_MODE_TICKLESS)
+    {
+        /* a tickless loop may sleep for minutes, the first event of a batch wakes it */
+        int locked = wheel_lock(wheel);
+        pthread_cond_signal(&wheel->wakeCond);
+        wheel_unlock(wheel, locked);
+    }
+    else if (wheel->mode == TIMEWHEEL_MODE_TIMERFD)
+    {
+        timerfdWakeFor(wheel, dueTick);
+    }
+}
+
+int timewheel_create_event_ex(TimeWheel_t *wheel, const TimeWheelEventSpec_t *spec, TimeWheelHandle_t *handleOut)
+{
+    if (wheel == NULL || spec == NULL || spec->cb == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    uint64_t intervalUs = specIntervalUs(wheel, spec);
+
+    if (checkInterval(wheel, intervalUs) != 0 || checkOverrun(spec->overrun) != 0 || checkCron(wheel, spec->cron) != 0)
+    {
+        return -1;
+    }
+
+    Event_t *event = eventpool_alloc(&wheel->pool);
+    if (event == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for event");
+        return -1;
+    }
+
+    countCreatedEvents(wheel, 1);
+    prepareEvent(wheel, event, spec, intervalUs, wheelTickNow(wheel));
+
+    /* read before the push, the event belongs to the loop once it is in the inbox */
+    uint64_t dueTick = firstDueTick(wheel, event);
+
+    /* the event may fire and be cancelled by someone else as soon as it is in the inbox */
+    if (handleOut != NULL)
+    {
+        *handleOut = makeHandle(event);
+    }
+
+    submitEvents(wheel, event, event, dueTick);
+
+    return 0;
+}
+
+int timewheel_create_events(TimeWheel_t *wheel, const TimeWheelEventSpec_t *specs, uint32_t count, TimeWheelHandle_t *handlesOut)
+{
+    if (wheel == NULL || specs == NULL || count == 0)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    /* all or nothing, so check every spec before taking any event */
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (specs[i].cb == NULL)
+        {
+            ERROR_TIME_LINE("invalid parameter: spec %u has no callback", i);
+            return -1;
+        }
+
+        if (checkInterval(wheel, specIntervalUs(wheel, &specs[i])) != 0 || checkOverrun(specs[i].overrun) != 0 ||
+                checkCron(wheel, specs[i].cron) != 0)
+        {
+            return -1;
+        }
+    }
+
+    Event_t *top = eventpool_alloc_batch(&wheel->pool, count);
+    if (top == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for %u events", count);
+        return -1;
+    }
+
+    /*
+     * The inbox is a stack, so the chain already runs from the last spec
+     * down to the first. All events count from the same tick.
+     */
+    uint64_t nowTick = wheelTickNow(wheel);
+    uint64_t dueTick = UINT64_MAX;
+    Event_t *event = top;
+    Event_t *bottom = top;
+
+    for (uint32_t i = count; i-- > 0; event = event->next)
+    {
+        prepareEvent(wheel, event, &specs[i], specIntervalUs(wheel, &specs[i]), nowTick);
+        if (firstDueTick(wheel, event) < dueTick)
+        {
+            dueTick = firstDueTick(wheel, event);
+        }
+        if (handlesOut != NULL)
+        {
+            handlesOut[i] = makeHandle(event);
+        }
+        bottom = event;
+    }
+
+    countCreatedEvents(wheel, count);
+    submitEvents(wheel, top, bottom, dueTick);
+
+    return 0;
+}
+
+int timewheel_cancel_event(TimeWheel_t *wheel, TimeWheelHandle_t handle)
+{
+    if (wheel == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    int locked = wheel_lock(wheel);
+    Event_t *event = lookupHandle(wheel, handle);
+    if (event == NULL)
+    {
+        wheel_unlock(wheel, locked);
+        return -1;
+    }
+
+    if (event->state == EVENT_STATE_SLOT || event->state == EVENT_STATE_OVERFLOW)
+    {
+        if (event->state == EVENT_STATE_SLOT)
+        {
+            wheelslot_unlink(wheel, event);
+        }
+        else
+        {
+            eventheap_remove(&wheel->overflow, event);
+        }
+        eventpool_release(&wheel->pool, event);
+    }
+    else
+    {
+        /* in the inbox or running its callback: the owner releases it, timewheel_touch() reads the state unlocked */
+        __atomic_store_n(&event->state, EVENT_STATE_CANCELLED, __ATOMIC_RELAXED);
+    }
+    wheel_unlock(wheel, locked);
+
+    return 0;
+}
+
+int timewheel_modify_event(TimeWheel_t *wheel, TimeWheelHandle_t handle, uint32_t interval)
+{
+    return timewheel_modify_event_us(wheel, handle, (uint64_t) interval * 1000);
+}
+
+int timewheel_modify_event_us(TimeWheel_t *wheel, TimeWheelHandle_t handle, uint64_t intervalUs)
+{
+    if (wheel == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    if (checkInterval(wheel, intervalUs) != 0)
+    {
+        return -1;
+    }
+
+    int locked = wheel_lock(wheel);
+    Event_t *event = lookupHandle(wheel, handle);
+    if (event == NULL || (event->flags & EVENT_FLAG_WALL) != 0)
+    {
+        /* a wall-clock schedule has no interval to change */
+        wheel_unlock(wheel, locked);
+        return -1;
+    }
+
+    /* the new interval counts from now */
+    event->intervalUs = intervalUs;
+    event->baseTick = wheelTickNow(wheel);
+    if (event->baseTick < wheel->currentTick)
+    {
+        event->baseTick = wheel->currentTick;
+    }
+
+    if (event->state == EVENT_STATE_SLOT || event->state == EVENT_STATE_OVERFLOW)
+    {
+        if (event->state == EVENT_STATE_SLOT)
+        {
+            wheelslot_unlink(wheel, event);
+        }
+        else
+        {
+            eventheap_remove(&wheel->overflow, event);
+        }
+
+        if (scheduleEvent(wheel, event, event->baseTick + intervalUs / wheel->stepUs - wheel->currentTick) != 0)
+        {
+            eventpool_release(&wheel->pool, event);
+        }
+
+        if (wheel->mode == TIMEWHEEL_MODE_TICKLESS)
+        {
+            pthread_cond_signal(&wheel->wakeCond);
+        }
+        else if (wheel->mode == TIMEWHEEL_MODE_TIMERFD)
+        {
+            timerfdWakeFor(wheel, event->baseTick + intervalUs / wheel->stepUs);
+        }
+    }
+    /* a firing event is rescheduled with the new interval when its callback returns */
+    wheel_unlock(wheel, locked);
+
+    return 0;
+}
+
+int timewheel_get_pool_stats(TimeWheel_t *wheel, EventPoolStats_t *stats)
+{
+    if (wheel == NULL || stats == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    EventPool_t *pool = &wheel->pool;
+    memset(stats, 0, sizeof(EventPoolStats_t));
+
+    pthread_mutex_lock(&pool->mutex);
+    stats->chunks = pool->chunkCount;
+    stats->capacity = pool->chunkCount * EVENT_POOL_CHUNK_SIZE;
+    stats->freeShared = pool->freeCount;
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < EVENT_POOL_CACHE_COUNT; i++)
+    {
+        stats->freeCached += __atomic_load_n(&pool->caches[i].count, __ATOMIC_RELAXED);
+    }
+
+    stats->inUse = __atomic_load_n(&pool->inUse, __ATOMIC_RELAXED);
+    stats->peakInUse = __atomic_load_n(&pool->peakInUse, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int timewheel_touch(TimeWheel_t *wheel, TimeWheelHandle_t handle)
+{
+    if (wheel == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    /*
+     * No lock and no relinking: only the activity tick is recorded, and
+     * processEvent() moves the event once when its slot comes round. The
+     * generation is stored with the tick, so a touch racing with the event
+     * being freed and reused is ignored by the new owner.
+     */
+    uint32_t generation = (uint32_t) (handle >> 32) & 0xFFFF;
+    Event_t *event = eventpool_get(&wheel->pool, (uint32_t) handle);
+
+    if (event == NULL || __atomic_load_n(&event->generation, __ATOMIC_ACQUIRE) != generation)
+    {
+        return -1;
+    }
+
+    /* cancelled, or finished its last run, but not yet freed by the loop thread */
+    if (__atomic_load_n(&event->state, __ATOMIC_RELAXED) == EVENT_STATE_CANCELLED)
+    {
+        return -1;
+    }
+
+    /* touch still holds the first due time of a wall-clock event, which is not idle-based anyway */
+    if ((__atomic_load_n(&event->flags, __ATOMIC_RELAXED) & EVENT_FLAG_WALL) != 0)
+    {
+        return -1;
+    }
+
+    uint64_t tick = wheelTickNow(wheel) & ((1ULL << 48) - 1);
+    __atomic_store_n(&event->touch, ((uint64_t) generation << 48) | tick, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+/* move a manual wheel to targetTick, running every callback due on the way */
+static int advanceManualWheel(TimeWheel_t *wheel, uint64_t targetTick)
+{
+    if (t_heldWheel == wheel)
+    {
+        ERROR_TIME_LINE("invalid call: a callback cannot advance its own wheel");
+        return -1;
+    }
+
+    /* another thread may advance the wheel too, its collect must not touch the batch before this one is dispatched */
+    pthread_mutex_lock(&wheel->workers.dispatchMutex);
+    pthread_mutex_lock(&wheel->mutex);
+    t_heldWheel = wheel;
+    uint64_t lockNs = getMonotonicNs();
+
+    drainInbox(wheel);
+    if (targetTick > wheel->currentTick)
+    {
+        /* virtual time has no backlog to spread, but the policies see one advance as one stall */
+        wheel->clockTick = targetTick;
+        advanceWheel(wheel, targetTick);
+    }
+
+    histogram_record(&wheel->latency.lockHold, getMonotonicNs() - lockNs);
+    t_heldWheel = NULL;
+    pthread_mutex_unlock(&wheel->mutex);
+
+    workerpool_dispatch(&wheel->workers);
+    histogram_record(&wheel->latency.tick, getMonotonicNs() - lockNs);
+    pthread_mutex_unlock(&wheel->workers.dispatchMutex);
+
+    return 0;
+}
+
+int timewheel_advance(TimeWheel_t *wheel, uint64_t ticks)
+{
+    if (wheel == NULL || wheel->mode != TIMEWHEEL_MODE_MANUAL)
+    {
+        ERROR_TIME_LINE("invalid parameter: only a TIMEWHEEL_MODE_MANUAL wheel is advanced by hand");
+        return -1;
+    }
+
+    return advanceManualWheel(wheel, __atomic_load_n(&wheel->currentTick, __ATOMIC_ACQUIRE) + ticks);
+}
+
+int timewheel_advance_to(TimeWheel_t *wheel, uint64_t deadlineUs)
+{
+    if (wheel == NULL || wheel->mode != TIMEWHEEL_MODE_MANUAL)
+    {
+        ERROR_TIME_LINE("invalid parameter: only a TIMEWHEEL_MODE_MANUAL wheel is advanced by hand");
+        return -1;
+    }
+
+    /* a deadline in the past only places the pending events */
+    return advanceManualWheel(wheel, deadlineUs / wheel->stepUs);
+}
+
+/* CLOCK_REALTIME microseconds as the wheel's wall-clock schedules see them, virtual for a manual wheel */
+uint64_t timewheel_wall_us(TimeWheel_t *wheel)
+{
+    if (wheel == NULL)
+    {
+        return 0;
+    }
+
+    return wallNowUs(wheel);
+}
+
+uint64_t timewheel_now_us(TimeWheel_t *wheel)
+{
+    if (wheel == NULL)
+    {
+        return 0;
+    }
+
+    return wheelTickNow(wheel) * wheel->stepUs;
+}
+
+int timewheel_get_fd(TimeWheel_t *wheel)
+{
+    return wheel != NULL ? wheel->timerFd : -1;
+}
+
+/*
+ * Run every callback due by now on the calling thread and re-arm the fd,
+ * called by the event loop whenever timewheel_get_fd() polls readable.
+ */
+int timewheel_process_expired(TimeWheel_t *wheel)
+{
+    if (wheel == NULL || wheel->mode != TIMEWHEEL_MODE_TIMERFD)
+    {
+        ERROR_TIME_LINE("invalid parameter: only a TIMEWHEEL_MODE_TIMERFD wheel is processed by the caller");
+        return -1;
+    }
+
+    if (t_heldWheel == wheel)
+    {
+        ERROR_TIME_LINE("invalid call: a callback cannot process its own wheel");
+        return -1;
+    }
+
+    /* clear the readiness, EAGAIN if the caller got here without the fd being readable */
+    uint64_t expirations;
+    while (read(wheel->timerFd, &expirations, sizeof(expirations)) < 0 && errno == EINTR)
+    {
+    }
+
+    uint64_t wakeNs = getMonotonicNs();
+    uint64_t nowTick = wheelTickNow(wheel);
+
+    /* several I/O threads may poll the same fd, one of them collects and dispatches at a time */
+    pthread_mutex_lock(&wheel->workers.dispatchMutex);
+    pthread_mutex_lock(&wheel->mutex);
+    t_heldWheel = wheel;
+    uint64_t lockNs = getMonotonicNs();
+
+    syncWallClock(wheel);
+    drainInbox(wheel);
+    if (nowTick > wheel->currentTick)
+    {
+        advanceWheel(wheel, catchupTarget(wheel, nowTick));
+    }
+    timerfdRearm(wheel);
+
+    histogram_record(&wheel->latency.lockHold, getMonotonicNs() - lockNs);
+    t_heldWheel = NULL;
+    pthread_mutex_unlock(&wheel->mutex);
+
+    workerpool_dispatch(&wheel->workers);
+    histogram_record(&wheel->latency.tick, getMonotonicNs() - wakeNs);
+    pthread_mutex_unlock(&wheel->workers.dispatchMutex);
+
+    return 0;
+}
+
+int timewheel_get_stats(TimeWheel_t *wheel, TimeWheelStats_t *stats)
+{
+    EventPoolStats_t poolStats;
+
+    if (wheel == NULL || stats == NULL || timewheel_get_pool_stats(wheel, &poolStats) != 0)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    stats->created = __atomic_load_n(&wheel->increaseId, __ATOMIC_RELAXED);
+    stats->fired = __atomic_load_n(&wheel->firedCount, __ATOMIC_RELAXED);
+    stats->slotsVisited = __atomic_load_n(&wheel->slotsVisited, __ATOMIC_RELAXED);
+    stats->missed = __atomic_load_n(&wheel->missedCount, __ATOMIC_RELAXED);
+    stats->pending = poolStats.inUse;
+    stats->capacity = poolStats.capacity;
+
+    return 0;
+}
+
+int timewheel_get_latency(TimeWheel_t *wheel, TimeWheelLatency_t *latency)
+{
+    if (wheel == NULL || latency == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    /* every thread writes its own histograms, reading them never blocks the loop or the workers */
+    memset(latency, 0, sizeof(TimeWheelLatency_t));
+    latency_merge(latency, &wheel->latency);
+    for (uint32_t i = 0; i < wheel->workers.workerCount; i++)
+    {
+        latency_merge(latency, &wheel->workers.workers[i].latency);
+    }
+
+    return 0;
+}
+
+uint64_t timewheel_histogram_percentile(const TimeWheelHistogram_t *hist, double percentile)
+{
+    if (hist == NULL || hist->count == 0)
+    {
+        return 0;
+    }
+
+    /* upper bound of the bucket holding the requested rank, never above the largest value seen */
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) hist->count + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    for (uint32_t i = 0; i < TIMEWHEEL_HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t value = histogram_bucket_max(i);
+            return value < hist->max ? value : hist->max;
+        }
     }
 
-    return 0;
+    return hist->max;
 }
 
-/* ==================== Loop Thread Function ==================== */
+/*
+ * Called from a callback: the periods its event missed before this run and
+ * which the FIRE_ONCE or SKIP overrun policy folded into it. 0 for punctual
+ * runs, FIRE_ALL events and outside of callbacks.
+ */
+uint32_t timewheel_missed_runs(void)
+{
+    return t_missedRuns;
+}
 
-static void* loopForInterval(void *arg)
+/* ==================== Sharded Wheels ==================== */
+
+TimeWheelShards_t* timewheel_shards_create(const TimeWheelConfig_t *config, uint32_t shardCount)
 {
-    if (arg == NULL)
+    if (config == NULL)
     {
-        DEBUG_TIME_LINE("invalid parameter");
+        ERROR_TIME_LINE("invalid parameter");
         return NULL;
     }
 
-    TimeWheel_t *wheel = (TimeWheel_t*) arg;
-
-    /* Use CLOCK_MONOTONIC for steady time measurement */
-    struct timespec startTime, nextTickTime;
-    clock_gettime(CLOCK_MONOTONIC, &startTime);
-
-    const int64_t stepNs = (int64_t) wheel->steps * 1000000LL; /* nanoseconds per step */
-    uint64_t processedTicks = 0; //how many slots passed since time wheel started
-
-    while (1)
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpuCount < 1)
     {
-        /* Calculate next tick time based on anchor and processedTicks */
-        int64_t nextTickNs = (int64_t) (processedTicks + 1) * stepNs;
-        nextTickTime.tv_sec = startTime.tv_sec + nextTickNs / 1000000000LL;
-        nextTickTime.tv_nsec = startTime.tv_nsec + nextTickNs % 1000000000LL;
+        cpuCount = 1;
+    }
 
-        /* Normalize timespec */
-        if (nextTickTime.tv_nsec >= 1000000000LL)
-        {
-            nextTickTime.tv_sec += nextTickTime.tv_nsec / 1000000000LL;
-            nextTickTime.tv_nsec = nextTickTime.tv_nsec % 1000000000LL;
-        }
+    if (shardCount == 0)
+    {
+        shardCount = (uint32_t) cpuCount;
+    }
 
-        /* Sleep until next tick time (absolute time) */
-        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &nextTickTime, NULL) == EINTR)
-        {
-            /* Retry if interrupted */
-        }
+    if (shardCount > (1U << (64 - TIMEWHEEL_HANDLE_SHARD_SHIFT)) - 1)
+    {
+        ERROR_TIME_LINE("invalid shard count: %u", shardCount);
+        return NULL;
+    }
 
-        /* Get current time to compute elapsed ticks */
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
+    TimeWheelShards_t *shards = (TimeWheelShards_t*) calloc(1, sizeof(TimeWheelShards_t));
+    if (shards == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for shards");
+        return NULL;
+    }
 
-        /* Calculate elapsed time in nanoseconds */
-        int64_t elapsedNs = (int64_t) (now.tv_sec - startTime.tv_sec) * 1000000000LL +
-                (int64_t) (now.tv_nsec - startTime.tv_nsec);
+    shards->wheels = (TimeWheel_t**) calloc(shardCount, sizeof(TimeWheel_t*));
+    if (shards->wheels == NULL)
+    {
+        ERROR_TIME_LINE("failed to allocate memory for shards");
+        free(shards);
+        return NULL;
+    }
 
-        if (elapsedNs < 0)
-        {
-            continue;
-        }
+    for (uint32_t i = 0; i < shardCount; i++)
+    {
+        TimeWheelConfig_t shardConfig = *config;
 
-        uint64_t ticksSinceStart = (uint64_t) (elapsedNs / stepNs);
-        if (ticksSinceStart < processedTicks + 1)
-        {
-            /* nothing new to process */
-            continue;
-        }
+        /* tick thread of shard i runs on CPU i, shards beyond the CPU count wrap around */
+        shardConfig.cpu = (int) (i % (uint32_t) cpuCount);
 
-        uint32_t totalPassed = (uint32_t) (ticksSinceStart - processedTicks); //how many slots passed
-        if (totalPassed == 0)
+        shards->wheels[i] = timewheel_create_ex(&shardConfig);
+        if (shards->wheels[i] == NULL)
         {
-            continue;
+            timewheel_shards_destroy(shards);
+            return NULL;
         }
+        shards->count++;
+    }
 
-        /* Process each intermediate step so no slots are skipped */
-        TimePos_t prevPos = wheel->timePos;
-        uint32_t baseMs = getCurrentMs(wheel, prevPos);
-
-        for (uint32_t i = 1; i <= totalPassed; ++i)
-        {
-            TimePos_t pos = { 0 };
-            uint32_t futureMs = baseMs + i * wheel->steps;
+    return shards;
+}
 
-            pos.pos_min = (futureMs / 1000 / 60) % wheel->thirdLevelCount;
-            pos.pos_sec = (futureMs % (1000 * 60)) / 1000;
-            pos.pos_ms = (futureMs % 1000) / wheel->steps;
+void timewheel_shards_destroy(TimeWheelShards_t *shards)
+{
+    if (shards == NULL)
+    {
+        return;
+    }
 
-            pthread_mutex_lock(&wheel->mutex);
+    for (uint32_t i = 0; i < shards->count; i++)
+    {
+        timewheel_destroy(shards->wheels[i]);
+    }
 
-            EventList_t *eventList = NULL;
+    free(shards->wheels);
+    free(shards);
+}
 
-            if (pos.pos_min != prevPos.pos_min)
-            {
-                eventList = &wheel->eventSlotArray.slots[wheel->firstLevelCount + wheel->secondLevelCount + pos.pos_min];
-                processEvent(wheel, eventList, pos);
-                eventlist_clear(eventList);
-            }
-            else if (pos.pos_sec != prevPos.pos_sec)
-            {
-                eventList = &wheel->eventSlotArray.slots[wheel->firstLevelCount + pos.pos_sec];
-                processEvent(wheel, eventList, pos);
-                eventlist_clear(eventList);
-            }
-            else if (pos.pos_ms != prevPos.pos_ms)
-            {
-                eventList = &wheel->eventSlotArray.slots[pos.pos_ms];
-                processEvent(wheel, eventList, pos);
-                eventlist_clear(eventList);
-            }
+int timewheel_shards_create_event(TimeWheelShards_t *shards, const TimeWheelEventSpec_t *spec, TimeWheelHandle_t *handleOut)
+{
+    if (shards == NULL || spec == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
 
-            pthread_mutex_unlock(&wheel->mutex);
+    /* the shard of the calling CPU, its tick thread is pinned next to the producer */
+    int cpu = sched_getcpu();
+    uint32_t shard = cpu < 0 ? 0 : (uint32_t) cpu % shards->count;
+    TimeWheelHandle_t handle = TIMEWHEEL_INVALID_HANDLE;
 
-            prevPos = pos;
-        }
+    if (timewheel_create_event_ex(shards->wheels[shard], spec, &handle) != 0)
+    {
+        return -1;
+    }
 
-        /* update wheel position and mark how many ticks we've processed */
-        wheel->timePos = prevPos;
-        processedTicks += totalPassed;
+    if (handleOut != NULL)
+    {
+        *handleOut = ((TimeWheelHandle_t) shard << TIMEWHEEL_HANDLE_SHARD_SHIFT) | handle;
     }
 
-    return NULL;
+    return 0;
 }
 
-int compareTimeSpec(struct timespec *t1, struct timespec *t2)
+int timewheel_shards_create_events(TimeWheelShards_t *shards, const TimeWheelEventSpec_t *specs, uint32_t count,
+        TimeWheelHandle_t *handlesOut)
 {
-    if (t1->tv_sec < t2->tv_sec || (t1->tv_sec == t2->tv_sec && t1->tv_nsec < t2->tv_nsec))
+    if (shards == NULL || specs == NULL)
     {
+        ERROR_TIME_LINE("invalid parameter");
         return -1;
     }
 
-    if (t1->tv_sec == t2->tv_sec && t1->tv_nsec == t2->tv_nsec)
+    /* the whole batch goes to the shard of the calling CPU */
+    int cpu = sched_getcpu();
+    uint32_t shard = cpu < 0 ? 0 : (uint32_t) cpu % shards->count;
+
+    if (timewheel_create_events(shards->wheels[shard], specs, count, handlesOut) != 0)
     {
-        return 0;
+        return -1;
     }
 
-    return 1;
+    for (uint32_t i = 0; handlesOut != NULL && i < count; i++)
+    {
+        handlesOut[i] |= (TimeWheelHandle_t) shard << TIMEWHEEL_HANDLE_SHARD_SHIFT;
+    }
+
+    return 0;
 }
 
-static uint64_t calcNextRunTime(uint64_t startMs, uint64_t intervalMs, uint64_t nowMs)
+static TimeWheel_t* shardOfHandle(TimeWheelShards_t *shards, TimeWheelHandle_t handle)
 {
-    if (startMs > nowMs)
+    uint32_t shard = (uint32_t) (handle >> TIMEWHEEL_HANDLE_SHARD_SHIFT);
+
+    return shard < shards->count ? shards->wheels[shard] : NULL;
+}
+
+int timewheel_shards_cancel_event(TimeWheelShards_t *shards, TimeWheelHandle_t handle)
+{
+    if (shards == NULL)
     {
-        return startMs;
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
     }
 
-    if (startMs == nowMs)
+    TimeWheel_t *wheel = shardOfHandle(shards, handle);
+    if (wheel == NULL)
     {
-        return startMs + intervalMs;
+        return -1;
     }
 
-    uint64_t count = (nowMs - startMs) / intervalMs;
-    uint64_t ms = startMs + count * intervalMs + intervalMs;
-
-    return ms;
+    return timewheel_cancel_event(wheel, handle & ((1ULL << TIMEWHEEL_HANDLE_SHARD_SHIFT) - 1));
 }
 
-static void sleep_until(struct timespec *nextTickTime)
+int timewheel_shards_modify_event(TimeWheelShards_t *shards, TimeWheelHandle_t handle, uint32_t interval)
 {
-    while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, nextTickTime, NULL) == EINTR)
+    if (shards == NULL)
+    {
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
+    }
+
+    TimeWheel_t *wheel = shardOfHandle(shards, handle);
+    if (wheel == NULL)
     {
-        /* Retry if interrupted */
+        return -1;
     }
+
+    return timewheel_modify_event(wheel, handle & ((1ULL << TIMEWHEEL_HANDLE_SHARD_SHIFT) - 1), interval);
 }
 
-static void* threadLoopNoTimeWheel(void *arg)
+int timewheel_shards_touch(TimeWheelShards_t *shards, TimeWheelHandle_t handle)
 {
-    EventList_t *pEventList = (EventList_t*) arg;
-    if (pEventList == NULL)
+    if (shards == NULL)
     {
-        return NULL;
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
     }
 
-    static const uint64_t stepNs = 10000000; /* nanoseconds per step */
-    Event_t *event = pEventList->head;
-    struct timespec now;
-    struct timespec nextTickTime;
-    arg_t *pArg = NULL;
-    uint64_t nowMs = 0;
-    while (1)
+    TimeWheel_t *wheel = shardOfHandle(shards, handle);
+    if (wheel == NULL)
     {
-        clock_gettime(CLOCK_REALTIME, &now);
-        nextTickTime.tv_sec = now.tv_sec + (now.tv_nsec + stepNs) / 1000000000;
-        nextTickTime.tv_nsec = (now.tv_nsec + stepNs) % 100000;
-        /* Sleep until next tick time (absolute time) */
-        sleep_until(&nextTickTime);
-        clock_gettime(CLOCK_REALTIME, &now);
-        event = pEventList->head;
-        while (event)
-        {
-            pArg = (arg_t*) event->arg;
-            nowMs = get_ms_by_timesp(&now);
-            if (nowMs >= pArg->nextTimemMs)
-            {
-                event->cb(event->arg);
-                pArg->nextTimemMs = calcNextRunTime(pArg->startTimeMs, pArg->interval, nowMs);
-            }
-
-            event = event->next;
-        }
+        return -1;
     }
 
-    return NULL;
+    return timewheel_touch(wheel, handle & ((1ULL << TIMEWHEEL_HANDLE_SHARD_SHIFT) - 1));
 }
 
-/* ==================== Public API Implementation ==================== */
-
-TimeWheel_t* timewheel_create(uint32_t steps, uint32_t maxMin)
+int timewheel_shards_get_stats(TimeWheelShards_t *shards, TimeWheelStats_t *stats)
 {
-    TimeWheel_t *wheel = (TimeWheel_t*) malloc(sizeof(TimeWheel_t));
-    if (wheel == NULL)
+    if (shards == NULL || stats == NULL)
     {
-        DEBUG_TIME_LINE("failed to allocate memory for timewheel");
-        return NULL;
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
     }
 
-    memset(wheel, 0, sizeof(TimeWheel_t));
+    memset(stats, 0, sizeof(TimeWheelStats_t));
 
-    if (timewheel_init(wheel, steps, maxMin) != 0)
+    for (uint32_t i = 0; i < shards->count; i++)
     {
-        free(wheel);
-        return NULL;
+        TimeWheelStats_t shardStats;
+
+        if (timewheel_get_stats(shards->wheels[i], &shardStats) != 0)
+        {
+            return -1;
+        }
+
+        stats->created += shardStats.created;
+        stats->fired += shardStats.fired;
+        stats->slotsVisited += shardStats.slotsVisited;
+        stats->missed += shardStats.missed;
+        stats->pending += shardStats.pending;
+        stats->capacity += shardStats.capacity;
     }
 
-    return wheel;
+    return 0;
 }
 
-void timewheel_destroy(TimeWheel_t *wheel)
+int timewheel_shards_get_latency(TimeWheelShards_t *shards, TimeWheelLatency_t *latency)
 {
-    if (wheel == NULL)
+    if (shards == NULL || latency == NULL)
     {
-        return;
+        ERROR_TIME_LINE("invalid parameter");
+        return -1;
     }
 
-    /* Cancel and join the loop thread */
-    pthread_cancel(wheel->loopThread);
-    pthread_join(wheel->loopThread, NULL);
-
-    /* Clear all event lists */
-    if (wheel->eventSlotArray.slots != NULL)
+    memset(latency, 0, sizeof(TimeWheelLatency_t));
+    for (uint32_t i = 0; i < shards->count; i++)
     {
-        for (uint32_t i = 0; i < wheel->eventSlotArray.size; i++)
+        TimeWheel_t *wheel = shards->wheels[i];
+
+        latency_merge(latency, &wheel->latency);
+        for (uint32_t j = 0; j < wheel->workers.workerCount; j++)
         {
-            eventlist_clear(&wheel->eventSlotArray.slots[i]);
+            latency_merge(latency, &wheel->workers.workers[j].latency);
         }
-        free(wheel->eventSlotArray.slots);
     }
 
-    pthread_mutex_destroy(&wheel->mutex);
-    free(wheel);
+    return 0;
 }
 
-int timewheel_init(TimeWheel_t *wheel, uint32_t steps, uint32_t maxMin)
+/* ==================== Event List API ==================== */
+
+int eventListInit(EventList_t *eventList)
 {
-    if (wheel == NULL)
+    return eventListInitEx(eventList, EVENTLIST_ENGINE_LIST);
+}
+
+int eventListInitEx(EventList_t *eventList, EventListEngine_t engine)
+{
+    return eventListInitAttr(eventList, engine, NULL);
+}
+
+int eventListInitAttr(EventList_t *eventList, EventListEngine_t engine, const TimeWheelThreadConfig_t *thread)
+{
+    if (eventList == NULL || checkThreadConfig(thread) != 0)
     {
-        DEBUG_TIME_LINE("invalid parameter: wheel is NULL");
+        ERROR_TIME_LINE("invalid parameter");
         return -1;
     }
 
-    if (1000 % steps != 0)
+    eventlist_init(eventList);
+
+    eventList->engine = engine;
+    eventList->heap = NULL;
+    eventList->wakeMs = UINT64_MAX;
+    eventList->firing = NULL;
+    eventList->stop = 0;
+
+    if (eventpool_init(&eventList->pool) != 0)
     {
-        DEBUG_TIME_LINE("invalid steps: must be a factor of 1000");
+        ERROR_TIME_LINE("failed to allocate memory for event pool");
         return -1;
     }
 
-    wheel->steps = steps;
-    wheel->firstLevelCount = 1000 / steps;
-    wheel->secondLevelCount = 60;
-    wheel->thirdLevelCount = maxMin;
-    wheel->increaseId = 0;
-
-    /* Allocate event slot array */
-    wheel->eventSlotArray.size = wheel->firstLevelCount + wheel->secondLevelCount + wheel->thirdLevelCount;
-    wheel->eventSlotArray.slots = (EventList_t*) malloc(sizeof(EventList_t) * wheel->eventSlotArray.size);
-    if (wheel->eventSlotArray.slots == NULL)
+    if (engine == EVENTLIST_ENGINE_HEAP)
     {
-        DEBUG_TIME_LINE("failed to allocate memory for event slots");
-        return -1;
+        eventList->heap = (EventHeap_t*) calloc(1, sizeof(EventHeap_t));
+        if (eventList->heap == NULL)
+        {
+            ERROR_TIME_LINE("failed to allocate memory for event heap");
+            eventpool_destroy(&eventList->pool);
+            return -1;
+        }
     }
 
-    /* Initialize all event lists */
-    for (uint32_t i = 0; i < wheel->eventSlotArray.size; i++)
+    if (pthread_mutex_init(&eventList->mutex, NULL) != 0)
     {
-        eventlist_init(&wheel->eventSlotArray.slots[i]);
+        ERROR_TIME_LINE("failed to initialize mutex");
+        free(eventList->heap);
+        eventpool_destroy(&eventList->pool);
+        return -1;
     }
 
-    /* Initialize mutex */
-    if (pthread_mutex_init(&wheel->mutex, NULL) != 0)
+    /* The list engine compares against the CLOCK_REALTIME times in arg_t, the heap keeps its own monotonic deadlines */
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, engine == EVENTLIST_ENGINE_HEAP ? CLOCK_MONOTONIC : CLOCK_REALTIME);
+    if (pthread_cond_init(&eventList->wakeCond, &condAttr) != 0)
     {
-        DEBUG_TIME_LINE("failed to initialize mutex");
-        free(wheel->eventSlotArray.slots);
+        ERROR_TIME_LINE("failed to initialize condition variable");
+        pthread_condattr_destroy(&condAttr);
+        pthread_mutex_destroy(&eventList->mutex);
+        free(eventList->heap);
+        eventpool_destroy(&eventList->pool);
         return -1;
     }
+    pthread_condattr_destroy(&condAttr);
 
-    /* Create loop thread */
-    int ret = pthread_create(&wheel->loopThread, NULL, threadLoopNoTimeWheel, wheel);
+    int ret = createLoopThread(&eventList->loopThread, thread, -1,
+            engine == EVENTLIST_ENGINE_HEAP ? threadLoopHeap : threadLoopNoTimeWheel, eventList);
     if (ret != 0)
     {
-        DEBUG_TIME_LINE("create thread error: %s", strerror(ret));
-        pthread_mutex_destroy(&wheel->mutex);
-        free(wheel->eventSlotArray.slots);
+        ERROR_TIME_LINE("create thread error: %s", strerror(ret));
+        pthread_cond_destroy(&eventList->wakeCond);
+        pthread_mutex_destroy(&eventList->mutex);
+        free(eventList->heap);
+        eventpool_destroy(&eventList->pool);
         return -1;
     }
 
     return 0;
 }
 
-int timewheel_create_event(TimeWheel_t *wheel, uint32_t interval, EventCallback_t callback, void *arg)
+int eventList_addEvent(EventList_t *eventList, uint32_t interval, EventCallback_t callback, void *arg)
 {
-    if (wheel == NULL || callback == NULL)
+    return eventList_addEventEx(eventList, interval, callback, arg, NULL);
+}
+
+int eventList_addEventEx(EventList_t *eventList, uint32_t interval, EventCallback_t callback, void *arg, Event_t **eventOut)
+{
+    if (eventList == NULL || callback == NULL || interval == 0)
     {
-        DEBUG_TIME_LINE("invalid parameter");
+        ERROR_TIME_LINE("invalid parameter");
         return -1;
     }
 
-    if (interval < wheel->steps || interval % wheel->steps != 0 ||
-            interval >= wheel->steps * wheel->firstLevelCount * wheel->secondLevelCount * wheel->thirdLevelCount)
+    if (eventList->engine == EVENTLIST_ENGINE_LIST && arg == NULL)
     {
-        DEBUG_TIME_LINE("invalid interval: %u", interval);
+        ERROR_TIME_LINE("invalid parameter: the list engine reads its run time from arg_t");
         return -1;
     }
 
-    Event_t *event = (Event_t*) malloc(sizeof(Event_t));
+    Event_t *event = eventpool_alloc(&eventList->pool);
     if (event == NULL)
     {
-        DEBUG_TIME_LINE("failed to allocate memory for event");
+        ERROR_TIME_LINE("failed to allocate memory for eventL");
         return -1;
     }
 
-    memset(event, 0, sizeof(Event_t));
-    event->interval = interval;
+    event->intervalUs = (uint64_t) interval * 1000;
     event->cb = callback;
     event->arg = arg;
-    event->timePos.pos_min = wheel->timePos.pos_min;
-    event->timePos.pos_sec = wheel->timePos.pos_sec;
-    event->timePos.pos_ms = wheel->timePos.pos_ms;
-    event->id = createEventId(wheel);
     event->next = NULL;
+    event->flags = EVENT_FLAG_OVERRUN_SKIP; /* what event lists always did, eventList_setOverrun() changes it */
 
-    /* Insert event to slot */
-    pthread_mutex_lock(&wheel->mutex);
-    insertEventToSlot(wheel, interval, event, wheel->timePos);
-    pthread_mutex_unlock(&wheel->mutex);
+    int locked = eventlist_lock(eventList);
+    uint64_t dueMs;
+    if (eventList->engine == EVENTLIST_ENGINE_HEAP)
+    {
+        dueMs = getMonotonicMs() + interval;
+        if (eventheap_push(eventList->heap, event, dueMs) != 0)
+        {
+            eventlist_unlock(eventList, locked);
+            eventpool_free(&eventList->pool, event);
+            ERROR_TIME_LINE("failed to allocate memory for event heap");
+            return -1;
+        }
+    }
+    else
+    {
+        eventlist_push_back(eventList, event);
+        dueMs = ((arg_t*) arg)->nextTimemMs;
+    }
 
-    DEBUG_TIME_LINE("create event over");
+    if (dueMs < eventList->wakeMs)
+    {
+        /* due before the loop thread would wake up on its own */
+        pthread_cond_signal(&eventList->wakeCond);
+    }
+
+    /* under the lock, so a callback of the loop thread sees it once the event can run */
+    if (eventOut != NULL)
+    {
+        *eventOut = event;
+    }
+    eventlist_unlock(eventList, locked);
 
     return 0;
 }
 
-int eventListInit(EventList_t *eventList)
+int eventList_cancelEvent(EventList_t *eventList, Event_t *event)
 {
-    eventlist_init(eventList);
-
-    if (pthread_mutex_init(&eventList->mutex, NULL) != 0)
+    if (eventList == NULL || event == NULL)
     {
-        DEBUG_TIME_LINE("failed to initialize mutex");
+        ERROR_TIME_LINE("invalid parameter");
         return -1;
     }
 
-    int ret = pthread_create(&eventList->loopThread, NULL, threadLoopNoTimeWheel, eventList);
-    if (ret != 0)
+    int locked = eventlist_lock(eventList);
+    if (eventList->engine == EVENTLIST_ENGINE_HEAP)
     {
-        DEBUG_TIME_LINE("create thread error: %s", strerror(ret));
-        pthread_mutex_destroy(&eventList->mutex);
-        return -1;
+        /* the back-pointer of a cancelled event is stale, only trust it while the heap slot points back */
+        uint32_t index = eventCold(event)->heapIndex;
+        if (index >= eventList->heap->size || eventList->heap->entries[index].event != event)
+        {
+            eventlist_unlock(eventList, locked);
+            ERROR_TIME_LINE("event not in heap");
+            return -1;
+        }
+
+        eventheap_remove(eventList->heap, event);
+    }
+    else
+    {
+        /* the list is singly linked, unlinking is a walk */
+        Event_t *prev = NULL;
+        Event_t *current = eventList->head;
+        while (current != NULL && current != event)
+        {
+            prev = current;
+            current = current->next;
+        }
+
+        if (current == NULL)
+        {
+            eventlist_unlock(eventList, locked);
+            ERROR_TIME_LINE("event not in list");
+            return -1;
+        }
+
+        if (prev == NULL)
+        {
+            eventList->head = event->next;
+        }
+        else
+        {
+            prev->next = event->next;
+        }
+
+        if (eventList->tail == event)
+        {
+            eventList->tail = prev;
+        }
+        eventList->count--;
     }
 
+    if (eventList->firing == event)
+    {
+        /* cancelled by its own callback, tells the loop thread not to touch it again */
+        eventList->firing = NULL;
+    }
+    eventlist_unlock(eventList, locked);
+
+    eventpool_free(&eventList->pool, event);
     return 0;
 }
 
-int eventList_addEvent(EventList_t *eventList, uint32_t interval, EventCallback_t callback, void *arg)
+int eventList_setOverrun(EventList_t *eventList, Event_t *event, TimeWheelOverrun_t overrun)
 {
-    Event_t *event = (Event_t*) calloc(1, sizeof(Event_t));
-    if (event == NULL)
+    if (eventList == NULL || event == NULL || checkOverrun(overrun) != 0)
     {
-        DEBUG_TIME_LINE("failed to allocate memory for eventL");
+        ERROR_TIME_LINE("invalid parameter");
         return -1;
     }
 
-    event->interval = interval;
-    event->cb = callback;
-    event->arg = arg;
-    event->next = NULL;
-
-    pthread_mutex_lock(&eventList->mutex);
-    eventlist_push_back(eventList, event);
-    pthread_mutex_unlock(&eventList->mutex);
+    int locked = eventlist_lock(eventList);
+    event->flags = (uint8_t) ((event->flags & ~EVENT_FLAGS_OVERRUN) | overrunFlags(overrun));
+    eventlist_unlock(eventList, locked);
 
     return 0;
-
 }
 
 void eventList_destroy(EventList_t *eventList)
@@ -614,12 +4912,21 @@ void eventList_destroy(EventList_t *eventList)
         return;
     }
 
-    pthread_cancel(eventList->loopThread);
+    pthread_mutex_lock(&eventList->mutex);
+    eventList->stop = 1;
+    pthread_cond_signal(&eventList->wakeCond);
+    pthread_mutex_unlock(&eventList->mutex);
     pthread_join(eventList->loopThread, NULL);
 
-    /* Clear all event lists */
-    eventlist_clear(eventList);
+    /* Events live in the pool chunks, so dropping the pool releases all of them */
+    if (eventList->heap != NULL)
+    {
+        free(eventList->heap->base);
+        free(eventList->heap);
+    }
+    eventpool_destroy(&eventList->pool);
 
+    pthread_cond_destroy(&eventList->wakeCond);
     pthread_mutex_destroy(&eventList->mutex);
     free(eventList);
 }
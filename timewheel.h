@@ -5,19 +5,51 @@
 #include <stdint.h>
 #include <pthread.h>
 
+/* Log levels, anything above TIMEWHEEL_LOG_LEVEL is compiled out */
+#define TIMEWHEEL_LOG_ERROR     0
+#define TIMEWHEEL_LOG_WARN      1
+#define TIMEWHEEL_LOG_INFO      2
+#define TIMEWHEEL_LOG_DEBUG     3
+#ifndef TIMEWHEEL_LOG_LEVEL
+#define TIMEWHEEL_LOG_LEVEL     TIMEWHEEL_LOG_DEBUG
+#endif
+
 #define FILE_LINE       __FILE__,__FUNCTION__,__LINE__
-#define DEBUG_BUFF_FORMAT(buf, bufSize, format, ...)    debugBufFormat2fp(stdout, FILE_LINE, (char*)buf, (int)bufSize, format, ##__VA_ARGS__)
+#define LOG_BUFF_FORMAT(level, buf, bufSize, format, ...)       do { \
+        if ((level) <= TIMEWHEEL_LOG_LEVEL) \
+            timewheel_log(level, FILE_LINE, (const void*)(buf), (int)(bufSize), format, ##__VA_ARGS__); \
+    } while (0)
+#define DEBUG_BUFF_FORMAT(buf, bufSize, format, ...)    LOG_BUFF_FORMAT(TIMEWHEEL_LOG_DEBUG, buf, bufSize, format, ##__VA_ARGS__)
 #define DEBUG_TIME_LINE(format, ...)    DEBUG_BUFF_FORMAT(NULL, 0, format, ##__VA_ARGS__)
+#define ERROR_TIME_LINE(format, ...)    LOG_BUFF_FORMAT(TIMEWHEEL_LOG_ERROR, NULL, 0, format, ##__VA_ARGS__)
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
+#define CACHE_LINE_SIZE         64
+#define EVENT_POOL_CHUNK_SHIFT  10
+#define EVENT_POOL_CHUNK_SIZE   (1U << EVENT_POOL_CHUNK_SHIFT) /* events per chunk */
+#define EVENT_POOL_MAX_CHUNKS   16384   /* chunk table is fixed so handle lookups need no lock */
+#define EVENT_POOL_CACHE_COUNT  16      /* producer free caches per pool */
+#define EVENT_POOL_CACHE_BATCH  64      /* events moved between a cache and the shared list */
+#define TIMEWHEEL_HIST_SUB_BITS 3       /* 8 buckets per power of two, about 12% resolution */
+#define TIMEWHEEL_HIST_BUCKETS  ((64 - TIMEWHEEL_HIST_SUB_BITS + 1) << TIMEWHEEL_HIST_SUB_BITS)
+#define TIMEWHEEL_LOG_RING_SIZE 256     /* records per logging thread, power of two */
+#define TIMEWHEEL_LOG_MAX_ARGS  12      /* conversions kept raw, longer formats are printed by the caller */
+#define TIMEWHEEL_LOG_TEXT_SIZE 160     /* copied strings and hex dump bytes of one record */
+#define TIMEWHEEL_CPU_WORDS     16      /* words of a thread's CPU set, 1024 CPUs like cpu_set_t */
+
 /* Time position in the wheel */
 typedef struct TimePos {
-        uint32_t pos_ms;
+        uint32_t pos_ms; /* tick within the second, one millisecond or less each */
         uint32_t pos_sec;
         uint32_t pos_min;
 } TimePos_t;
 
+/* Opaque event handle: pool index in bits 0-31, generation in bits 32-47, 0 is never valid */
+typedef uint64_t TimeWheelHandle_t;
+#define TIMEWHEEL_INVALID_HANDLE        0
+#define TIMEWHEEL_HANDLE_SHARD_SHIFT    48      /* sharded handles keep the shard above this bit */
+
 typedef void (*EventCallback_t)(void*); //Event callback function type
 typedef void (*freeCallback_t)(void*);  //Free argument callback function type
 
@@ -32,36 +64,272 @@ typedef struct eventArg {
         uint32_t interval;              // interval in milliseconds
 } arg_t;
 
-/* Event structure */
+/* Event flags */
+#define TIMEWHEEL_EVENT_INLINE  0x01    /* run the callback on the loop thread even if the wheel has workers */
+#define TIMEWHEEL_EVENT_WALLCLOCK 0x02  /* due at CLOCK_REALTIME multiples of the interval since the epoch, e.g. on every full minute */
+
+/* Cron flags */
+#define TIMEWHEEL_CRON_UTC      0x01    /* fields are UTC instead of local time */
+#define TIMEWHEEL_CRON_ANY_DOM  0x02    /* day of month was '*', set by timewheel_cron_parse() */
+#define TIMEWHEEL_CRON_ANY_DOW  0x04    /* day of week was '*', set by timewheel_cron_parse() */
+
+/* Compiled cron expression, bit n of a field is set when value n matches */
+typedef struct TimeWheelCron {
+        uint64_t seconds; /* 0-59 */
+        uint64_t minutes; /* 0-59 */
+        uint32_t hours; /* 0-23 */
+        uint32_t daysOfMonth; /* 1-31 */
+        uint16_t months; /* 1-12 */
+        uint8_t daysOfWeek; /* 0-6, Sunday is 0 */
+        uint8_t flags; /* TIMEWHEEL_CRON_xxx */
+} TimeWheelCron_t;
+
+#define EVENT_INDEX_NONE        UINT32_MAX /* end of a slot list */
+
+/*
+ * Event structure, exactly one cache line: everything a slot visit reads.
+ * The rest lives in the EventCold_t with the same pool index.
+ */
 typedef struct Event {
-        uint32_t id;
         EventCallback_t cb;
         arg_t *arg;
+        uint64_t baseTick; /* wheel tick the current interval counts from */
+        uint64_t intervalUs; /* microseconds, whole milliseconds for event lists */
+        uint64_t touch; /* generation << 48 | wheel tick of the last timewheel_touch() */
+        struct Event *next; /* inbox, pool free lists and event lists */
+        uint32_t index; /* position in the event pool, fixed for the life of the pool */
+        uint32_t slotNext; /* pool index of the next event in the same slot, EVENT_INDEX_NONE at the tail */
+        uint32_t slotPrev; /* pool index of the previous event in the same slot, EVENT_INDEX_NONE at the head */
+        uint16_t generation; /* bumped every time the event returns to the pool, never 0 */
+        uint8_t state; /* EVENT_STATE_xxx */
+        uint8_t flags; /* TIMEWHEEL_EVENT_xxx */
+} __attribute__((aligned(CACHE_LINE_SIZE))) Event_t;
+
+/* Fields of an event that are only needed when it fires, is released or moves between slots */
+typedef struct EventCold {
         freeCallback_t freeArgCb;
-        TimePos_t timePos;
-        uint32_t interval;
-        struct Event *next; /* for linked list */
-} Event_t;
+        struct TimeWheelHistogram *lateness; /* caller's per-event lateness histogram, may be NULL */
+        uint32_t repeat; /* fires left, 0 repeats until cancelled */
+        uint32_t refs; /* the wheel's reference plus one per callback queued on a worker */
+        uint32_t slackTicks; /* EVENT_FLAG_SLACK: ticks the event may fire late */
+        const TimeWheelCron_t *cron; /* due whenever it matches, NULL for interval events */
+        union {
+                uint32_t slotIndex; /* EVENT_STATE_SLOT: slot the event is linked into */
+                uint32_t heapIndex; /* EVENT_STATE_OVERFLOW or an event list heap: position in the heap */
+        };
+} EventCold_t;
+
+/* Producer free cache, one cache line each so producers do not false-share */
+typedef struct EventPoolCache {
+        Event_t *head;
+        uint32_t count; /* written under lock, read without it by timewheel_get_pool_stats() */
+        pthread_spinlock_t lock;
+} __attribute__((aligned(CACHE_LINE_SIZE))) EventPoolCache_t;
+
+/* Event pool: growable chunks of Event_t, owned by one wheel or event list */
+typedef struct EventPool {
+        Event_t **chunks; /* EVENT_POOL_MAX_CHUNKS entries, cache-line aligned, EVENT_POOL_CHUNK_SIZE events then their EventCold_t */
+        uint32_t chunkCount; /* published with release order after the chunk is set up */
+        Event_t *freeList; /* shared free list, refills the caches */
+        uint32_t freeCount;
+        uint32_t inUse; /* events handed out, updated atomically */
+        uint32_t peakInUse;
+        pthread_mutex_t mutex; /* protects chunks and shared free list */
+        EventPoolCache_t caches[EVENT_POOL_CACHE_COUNT];
+} EventPool_t;
+
+/* Event pool occupancy counters */
+typedef struct EventPoolStats {
+        uint32_t chunks; /* chunks allocated */
+        uint32_t capacity; /* events in all chunks */
+        uint32_t inUse; /* events currently scheduled or being built */
+        uint32_t peakInUse;
+        uint32_t freeShared; /* free events in the shared list */
+        uint32_t freeCached; /* free events parked in producer caches */
+} EventPoolStats_t;
+
+/* What a periodic event does about the runs it missed while its wheel or list was behind the clock */
+typedef enum TimeWheelOverrun {
+        TIMEWHEEL_OVERRUN_FIRE_ALL = 0, /* run once for every missed period, back to back */
+        TIMEWHEEL_OVERRUN_FIRE_ONCE, /* run once, the next period counts from that late run */
+        TIMEWHEEL_OVERRUN_SKIP, /* run once, the next run stays on the original schedule */
+} TimeWheelOverrun_t;
+
+/* How an event list finds its due events */
+typedef enum EventListEngine {
+        EVENTLIST_ENGINE_LIST = 0, /* linear scan, due time read from the caller's arg_t */
+        EVENTLIST_ENGINE_HEAP, /* 4-ary min-heap keyed on the event's own deadline */
+} EventListEngine_t;
+
+/* Heap slot, four siblings share one cache line */
+typedef struct EventHeapEntry {
+        uint64_t deadline;
+        Event_t *event;
+} EventHeapEntry_t;
+
+/* Contiguous 4-ary min-heap of events */
+typedef struct EventHeap {
+        EventHeapEntry_t *entries; /* entries[0] is the root */
+        EventHeapEntry_t *base; /* allocation, aligned so sibling groups start on a cache line */
+        uint32_t size;
+        uint32_t capacity;
+} EventHeap_t;
 
 /* Event list node (linked list) */
 typedef struct EventList {
         Event_t *head;
         Event_t *tail;
         uint32_t count;
+        EventListEngine_t engine;
+        EventPool_t pool; /* storage for the events of this list */
+        EventHeap_t *heap; /* heap engine only */
         pthread_t loopThread;
         pthread_mutex_t mutex;
+        pthread_cond_t wakeCond; /* signalled when an earlier event is added */
+        uint64_t wakeMs; /* ms the loop thread sleeps until, CLOCK_MONOTONIC for the heap engine */
+        Event_t *firing; /* event whose callback the loop thread is running, cleared if the callback cancels it */
+        uint32_t stop; /* asks the loop thread to exit */
 } EventList_t;
 
+/* Occupancy bitmap of one wheel level, bit n is set while slot n holds events */
+typedef struct SlotBitmap {
+        uint64_t *words;
+        uint32_t size; /* slots in this level */
+} SlotBitmap_t;
+
+/* Wheel slot: pool indices of the first and last linked event */
+typedef struct WheelSlot {
+        uint32_t head; /* EVENT_INDEX_NONE while empty */
+        uint32_t tail;
+} WheelSlot_t;
+
 /* Event slot array */
 typedef struct EventSlotArray {
-        EventList_t *slots;
+        WheelSlot_t *slots;
         uint32_t size;
 } EventSlotArray_t;
 
+/* Log-linear (HDR style) histogram of nanosecond values, updated with relaxed atomics */
+typedef struct TimeWheelHistogram {
+        uint64_t counts[TIMEWHEEL_HIST_BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+} TimeWheelHistogram_t;
+
+/* Latency histograms, one set per writing thread, summed by timewheel_get_latency() */
+typedef struct TimeWheelLatency {
+        TimeWheelHistogram_t lateness; /* callback start minus its scheduled deadline */
+        TimeWheelHistogram_t callback; /* callback run time */
+        TimeWheelHistogram_t tick; /* one wake up of the loop thread: drain, process and dispatch */
+        TimeWheelHistogram_t lockHold; /* wheel->mutex held by the loop thread */
+} TimeWheelLatency_t;
+
+/* Callback handed to a worker */
+typedef struct TimeWheelJob {
+        EventCallback_t cb;
+        void *arg;
+        Event_t *event; /* reference released once the callback returned */
+        uint64_t dueNs; /* CLOCK_MONOTONIC deadline the callback was due at */
+        uint32_t missed; /* periods the overrun policy folded into this run */
+} TimeWheelJob_t;
+
+/* Callback worker with its own job ring, idle workers steal from the others */
+typedef struct TimeWheelWorker {
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        TimeWheelJob_t *jobs; /* ring buffer */
+        uint32_t head;
+        uint32_t count;
+        uint32_t capacity;
+        struct TimeWheelWorkerPool *pool;
+        TimeWheelLatency_t latency; /* written by this worker only */
+} __attribute__((aligned(CACHE_LINE_SIZE))) TimeWheelWorker_t;
+
+/* Callback workers of one wheel */
+typedef struct TimeWheelWorkerPool {
+        TimeWheelWorker_t *workers;
+        uint32_t workerCount; /* 0: every callback runs on the loop thread */
+        uint32_t nextWorker; /* round-robin start of the next dispatch */
+        uint32_t stop; /* set under each worker mutex in turn, so read atomically */
+        EventPool_t *eventPool; /* where events released by the workers go back to */
+        TimeWheelLatency_t *loopLatency; /* for callbacks the loop thread has to run itself */
+        TimeWheelJob_t *batch; /* due callbacks collected by the loop thread */
+        uint32_t batchCount;
+        uint32_t batchCapacity;
+        pthread_mutex_t dispatchMutex; /* held by a caller driving the wheel from collecting the batch to dispatching it */
+} TimeWheelWorkerPool_t;
+
+/* Event creation parameters, fill with timewheel_event_spec_default() first */
+typedef struct TimeWheelEventSpec {
+        uint32_t interval; /* milliseconds, a multiple of the tick */
+        uint64_t intervalUs; /* microseconds, used instead of interval when non-zero */
+        EventCallback_t cb;
+        void *arg;
+        uint32_t flags; /* TIMEWHEEL_EVENT_xxx */
+        uint32_t repeat; /* times to fire, 1 for a one-shot timer, 0 fires until cancelled */
+        freeCallback_t freeArgCb; /* given arg once the event finished or was cancelled, may be NULL */
+        TimeWheelHistogram_t *lateness; /* also record this event's lateness here, zeroed and kept alive by the caller */
+        uint64_t slackUs; /* may fire up to this much late to share a slot with other events, 0 fires on its own tick */
+        TimeWheelOverrun_t overrun; /* runs missed while the wheel was behind, TIMEWHEEL_OVERRUN_FIRE_ALL by default */
+        uint64_t atUs; /* CLOCK_REALTIME microseconds of the first run instead of one interval from now, 0 for none */
+        const TimeWheelCron_t *cron; /* fire whenever it matches instead of every interval, kept alive by the caller */
+} TimeWheelEventSpec_t;
+
+/* How the loop thread of a wheel waits */
+typedef enum TimeWheelMode {
+        TIMEWHEEL_MODE_TICK = 0, /* wake up every step */
+        TIMEWHEEL_MODE_TICKLESS, /* sleep until the next occupied slot */
+        TIMEWHEEL_MODE_MANUAL, /* no loop thread, virtual time moved by timewheel_advance() */
+        TIMEWHEEL_MODE_TIMERFD, /* no loop thread, poll timewheel_get_fd() and call timewheel_process_expired() */
+} TimeWheelMode_t;
+
+/* How a loop thread is scheduled, all zero is a default thread */
+typedef struct TimeWheelThreadConfig {
+        int policy; /* SCHED_OTHER, or SCHED_FIFO / SCHED_RR so application threads cannot delay the ticks */
+        int priority; /* sched_priority of SCHED_FIFO and SCHED_RR */
+        size_t stackSize; /* bytes, 0 keeps the default */
+        uint64_t cpus[TIMEWHEEL_CPU_WORDS]; /* bit n allows CPU n, all zero runs anywhere */
+} TimeWheelThreadConfig_t;
+
+/* Wheel creation parameters, fill with timewheel_config_default() first */
+typedef struct TimeWheelConfig {
+        uint32_t steps; /* milliseconds of one tick, a factor of 1000 */
+        uint32_t stepUs; /* microseconds of one tick, a factor of 1000000, used instead of steps when non-zero */
+        uint32_t spinUs; /* busy-wait this long before every wake-up instead of sleeping, 0 only sleeps */
+        uint32_t maxMin; /* minute slots */
+        TimeWheelMode_t mode;
+        uint32_t workerCount; /* callback worker threads, 0 runs callbacks on the loop thread */
+        int cpu; /* pin the loop thread to this CPU, -1 leaves it unpinned */
+        uint32_t catchupTicks; /* most ticks one wake-up processes when behind, the rest waits for the next tick; 0 catches up at once */
+        TimeWheelThreadConfig_t thread; /* loop thread scheduling, cpu above is added to its CPU set */
+        uint32_t prefaultEvents; /* events allocated and touched at creation, so the first timers take no page faults */
+        int lockMemory; /* mlockall() current and future pages of the process, needs CAP_IPC_LOCK or RLIMIT_MEMLOCK */
+} TimeWheelConfig_t;
+
+/* Counters of one wheel, or summed over all shards */
+typedef struct TimeWheelStats {
+        uint64_t created; /* events created */
+        uint64_t fired; /* callbacks run or dispatched */
+        uint64_t slotsVisited; /* occupied slots processed */
+        uint64_t missed; /* periodic runs folded into a later run by TIMEWHEEL_OVERRUN_FIRE_ONCE or SKIP */
+        uint32_t pending; /* events currently held by the wheel */
+        uint32_t capacity; /* events the pools can hold without growing */
+} TimeWheelStats_t;
+
+/* Wall-clock event of a wheel, stale once the generation moved on */
+typedef struct TimeWheelWallEvent {
+        Event_t *event;
+        uint16_t generation;
+} TimeWheelWallEvent_t;
+
 /* TimeWheel structure */
 typedef struct TimeWheel {
         EventList_t eventList;
         EventSlotArray_t eventSlotArray; /* event slot array */
+        SlotBitmap_t levelBitmap[3]; /* occupied slots of millisecond, second and minute level */
+        EventHeap_t overflow; /* events a full wheel period or more away, keyed by due tick */
         TimePos_t timePos; /* current time position of wheel */
         pthread_t loopThread; /* thread for loop */
 
@@ -69,24 +337,125 @@ typedef struct TimeWheel {
         uint32_t secondLevelCount; /* second level, fixed to 60 */
         uint32_t thirdLevelCount; /* minute level */
 
-        uint32_t steps; /* milliseconds of one tick */
-        uint32_t increaseId; /* event id increase number */
+        uint32_t stepUs; /* microseconds of one tick */
+        uint32_t spinUs; /* tail of every wait spent spinning on the clock */
+        uint32_t catchupTicks; /* limit of one advance while behind, 0 for none */
+        uint32_t increaseId; /* events created so far */
         pthread_mutex_t mutex; /* mutex for event slot list */
+        EventPool_t pool; /* storage for all events of this wheel */
+
+        TimeWheelMode_t mode;
+        pthread_cond_t wakeCond; /* CLOCK_MONOTONIC, wakes a tickless loop early */
+        struct timespec startTime; /* CLOCK_MONOTONIC time of tick 0, set before the loop thread starts */
+        uint64_t currentTick; /* ticks processed since the loop started, timePos matches it, written atomically */
+        uint64_t clockTick; /* tick of the clock when the current advance started, ahead of currentTick while catching up */
+        uint64_t wakeTick; /* tick a tickless loop sleeps until or the timerfd is armed for, UINT64_MAX if none */
+        int timerFd; /* TIMEWHEEL_MODE_TIMERFD only, -1 otherwise */
+        uint32_t stop; /* asks the loop thread to exit */
+        Event_t *inbox; /* lock-free stack of new events, drained by the loop thread */
+        TimeWheelWorkerPool_t workers; /* optional callback dispatch */
+        uint64_t firedCount; /* written by the loop thread only */
+        uint64_t slotsVisited; /* written by the loop thread only */
+        uint64_t missedCount; /* written by the loop thread only */
+        TimeWheelLatency_t latency; /* written by the loop thread only */
+        uint64_t realStartUs; /* CLOCK_REALTIME microseconds of tick 0, moved when the clock is set, written atomically */
+        TimeWheelWallEvent_t *wallEvents; /* events scheduled on CLOCK_REALTIME, re-placed when the clock is set */
+        uint32_t wallCount; /* written atomically */
+        uint32_t wallCapacity;
+        struct TimeWheel *watchNext; /* next wheel woken when CLOCK_REALTIME is set */
 } TimeWheel_t;
 
+/* One log call: the format is printed by the log thread from the raw arguments */
+typedef struct TimeWheelLogRecord {
+        uint64_t timeNs; /* CLOCK_MONOTONIC */
+        const char *file;
+        const char *func;
+        const char *fmt;
+        int32_t line;
+        uint8_t level;
+        uint8_t formatted; /* text already holds the message, fmt had conversions the log thread cannot replay */
+        uint16_t textLen;
+        uint16_t hexOffset; /* hex dump bytes in text */
+        uint16_t hexLen;
+        uint32_t hexTotal; /* bytes the caller passed, more than hexLen if truncated */
+        uint64_t args[TIMEWHEEL_LOG_MAX_ARGS]; /* raw values, strings as offsets into text */
+        char text[TIMEWHEEL_LOG_TEXT_SIZE];
+} TimeWheelLogRecord_t;
+
+/* Single producer ring of one logging thread, handed to the next thread once its owner exits */
+typedef struct TimeWheelLogRing {
+        uint32_t tail; /* written by the owner */
+        uint32_t owned;
+        uint64_t dropped; /* records lost to a full ring */
+        uint32_t head __attribute__((aligned(CACHE_LINE_SIZE))); /* written by the log thread */
+        uint32_t drainTail; /* tail seen when the drain in progress started */
+        struct TimeWheelLogRing *next;
+        TimeWheelLogRecord_t records[TIMEWHEEL_LOG_RING_SIZE];
+} TimeWheelLogRing_t;
+
+/* One wheel per CPU, producers use the wheel of the CPU they run on */
+typedef struct TimeWheelShards {
+        TimeWheel_t **wheels;
+        uint32_t count;
+} TimeWheelShards_t;
+
 int eventListInit(EventList_t *eventList);
+int eventListInitEx(EventList_t *eventList, EventListEngine_t engine);
+int eventListInitAttr(EventList_t *eventList, EventListEngine_t engine, const TimeWheelThreadConfig_t *thread);
 int eventList_addEvent(EventList_t *eventList, uint32_t interval, EventCallback_t callback, void *arg);
+int eventList_addEventEx(EventList_t *eventList, uint32_t interval, EventCallback_t callback, void *arg, Event_t **eventOut);
+int eventList_cancelEvent(EventList_t *eventList, Event_t *event);
+int eventList_setOverrun(EventList_t *eventList, Event_t *event, TimeWheelOverrun_t overrun);
 void eventList_destroy(EventList_t *eventList);
 /* Public API functions */
 TimeWheel_t* timewheel_create(uint32_t steps, uint32_t maxMin);
+TimeWheel_t* timewheel_create_ex(const TimeWheelConfig_t *config);
 void timewheel_destroy(TimeWheel_t *wheel);
 int timewheel_init(TimeWheel_t *wheel, uint32_t steps, uint32_t maxMin);
+int timewheel_init_ex(TimeWheel_t *wheel, const TimeWheelConfig_t *config);
+void timewheel_config_default(TimeWheelConfig_t *config, uint32_t steps, uint32_t maxMin);
 int timewheel_create_event(TimeWheel_t *wheel, uint32_t interval, EventCallback_t callback, void *arg);
+int timewheel_create_event_ex(TimeWheel_t *wheel, const TimeWheelEventSpec_t *spec, TimeWheelHandle_t *handleOut);
+int timewheel_create_events(TimeWheel_t *wheel, const TimeWheelEventSpec_t *specs, uint32_t count, TimeWheelHandle_t *handlesOut);
+void timewheel_event_spec_default(TimeWheelEventSpec_t *spec, uint32_t interval, EventCallback_t callback, void *arg);
+int timewheel_get_pool_stats(TimeWheel_t *wheel, EventPoolStats_t *stats);
+int timewheel_cancel_event(TimeWheel_t *wheel, TimeWheelHandle_t handle);
+int timewheel_modify_event(TimeWheel_t *wheel, TimeWheelHandle_t handle, uint32_t interval);
+int timewheel_modify_event_us(TimeWheel_t *wheel, TimeWheelHandle_t handle, uint64_t intervalUs);
+int timewheel_touch(TimeWheel_t *wheel, TimeWheelHandle_t handle);
+int timewheel_advance(TimeWheel_t *wheel, uint64_t ticks);
+int timewheel_advance_to(TimeWheel_t *wheel, uint64_t deadlineUs);
+uint64_t timewheel_now_us(TimeWheel_t *wheel);
+uint64_t timewheel_wall_us(TimeWheel_t *wheel);
+int timewheel_cron_parse(TimeWheelCron_t *cron, const char *expr);
+int timewheel_cron_next(const TimeWheelCron_t *cron, uint64_t afterUs, uint64_t *nextUs);
+int timewheel_get_fd(TimeWheel_t *wheel);
+int timewheel_process_expired(TimeWheel_t *wheel);
+int timewheel_get_stats(TimeWheel_t *wheel, TimeWheelStats_t *stats);
+int timewheel_get_latency(TimeWheel_t *wheel, TimeWheelLatency_t *latency);
+uint64_t timewheel_histogram_percentile(const TimeWheelHistogram_t *hist, double percentile);
+uint32_t timewheel_missed_runs(void);
+
+/* Sharded wheels */
+TimeWheelShards_t* timewheel_shards_create(const TimeWheelConfig_t *config, uint32_t shardCount);
+void timewheel_shards_destroy(TimeWheelShards_t *shards);
+int timewheel_shards_create_event(TimeWheelShards_t *shards, const TimeWheelEventSpec_t *spec, TimeWheelHandle_t *handleOut);
+int timewheel_shards_create_events(TimeWheelShards_t *shards, const TimeWheelEventSpec_t *specs, uint32_t count,
+        TimeWheelHandle_t *handlesOut);
+int timewheel_shards_cancel_event(TimeWheelShards_t *shards, TimeWheelHandle_t handle);
+int timewheel_shards_modify_event(TimeWheelShards_t *shards, TimeWheelHandle_t handle, uint32_t interval);
+int timewheel_shards_touch(TimeWheelShards_t *shards, TimeWheelHandle_t handle);
+int timewheel_shards_get_stats(TimeWheelShards_t *shards, TimeWheelStats_t *stats);
+int timewheel_shards_get_latency(TimeWheelShards_t *shards, TimeWheelLatency_t *latency);
 
 /* Utility functions */
 uint64_t get_ms_by_timesp(struct timespec *tp);
 void get_local_time(char *buf, uint32_t bufLen);
 void debugBufFormat2fp(FILE *fp, const char *file, const char *func,
         int line, char *buf, int len, const char *fmt, ...);
+void timewheel_log(int level, const char *file, const char *func, int line, const void *buf, int len,
+        const char *fmt, ...) __attribute__((format(printf, 7, 8)));
+void timewheel_log_set_fd(int fd);
+void timewheel_log_flush(void);
 
 #endif /* TIMEWHEEL_H */
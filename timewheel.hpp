@@ -0,0 +1,1137 @@
+#ifndef TIMEWHEEL_HPP
+#define TIMEWHEEL_HPP
+
+/*
+ * Header-only C++17 timer wheel with the geometry fixed at compile time.
+ *
+ * TimeWheel<TickNs, Sizes...> is the same hierarchical design as the C
+ * wheel in timewheel.h: levels of slots with an occupancy bitmap, events
+ * pooled in chunks and linked into their slots by 32-bit pool indices, and
+ * handles that carry a generation so a stale one never hits a reused event.
+ * Every level size is a power of two, so positions are shifts and masks of
+ * the 64-bit tick instead of divisions by runtime step counts.
+ *
+ * The wheel has no thread of its own. One thread, usually an event loop,
+ * creates and cancels timers and drives time with poll() or advance(), like
+ * a TIMEWHEEL_MODE_TIMERFD or TIMEWHEEL_MODE_MANUAL wheel; callbacks run on
+ * that thread.
+ *
+ *     mycpp::TimeWheel<1000000, 256, 64, 64, 64> wheel;   // 1 ms ticks, 2^26 ms range
+ *     auto timer = wheel.add(std::chrono::milliseconds(250), [&] { onTimeout(); });
+ *     ...
+ *     epoll_wait(epfd, events, maxEvents, wheel.next_timeout_ms());
+ *     wheel.poll();
+ *
+ * Built as C++20, sleep_for(), sleep_until() and with_timeout() are
+ * awaitable from coroutines, resumed by poll()/advance() or posted to an
+ * executor.
+ */
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <optional>
+#define TIMEWHEEL_HPP_COROUTINES 1
+#endif
+
+namespace mycpp
+{
+
+/*
+ * Move-only type-erased void() callable. Functors up to InlineSize bytes
+ * that move without throwing live inside the object, so a lambda capturing
+ * a few pointers costs no allocation; larger ones go to the heap.
+ */
+class TimerCallback
+{
+public:
+    static constexpr std::size_t InlineSize = 4 * sizeof(void*);
+
+    TimerCallback() noexcept = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, TimerCallback>::value>>
+    TimerCallback(F &&f)
+    {
+        using Fn = std::decay_t<F>;
+
+        if constexpr (fitsInline<Fn>())
+        {
+            ::new (static_cast<void*>(storage_)) Fn(std::forward<F>(f));
+            ops_ = &InlineOps<Fn>::ops;
+        }
+        else
+        {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &HeapOps<Fn>::ops;
+        }
+    }
+
+    TimerCallback(TimerCallback &&other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    TimerCallback& operator=(TimerCallback &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    TimerCallback(const TimerCallback&) = delete;
+    TimerCallback& operator=(const TimerCallback&) = delete;
+
+    ~TimerCallback()
+    {
+        reset();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+
+    void operator()()
+    {
+        ops_->invoke(storage_);
+    }
+
+    void reset() noexcept
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src) noexcept; /* leaves src destroyed */
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void *storage)
+        {
+            (*static_cast<Fn*>(storage))();
+        }
+
+        static void move(void *dst, void *src) noexcept
+        {
+            ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+
+        static void destroy(void *storage) noexcept
+        {
+            static_cast<Fn*>(storage)->~Fn();
+        }
+
+        static constexpr Ops ops = { invoke, move, destroy };
+    };
+
+    template <typename Fn>
+    struct HeapOps
+    {
+        static void invoke(void *storage)
+        {
+            (**static_cast<Fn**>(storage))();
+        }
+
+        static void move(void *dst, void *src) noexcept
+        {
+            *static_cast<Fn**>(dst) = *static_cast<Fn**>(src);
+        }
+
+        static void destroy(void *storage) noexcept
+        {
+            delete *static_cast<Fn**>(storage);
+        }
+
+        static constexpr Ops ops = { invoke, move, destroy };
+    };
+
+    void moveFrom(TimerCallback &other) noexcept
+    {
+        if (other.ops_ != nullptr)
+        {
+            other.ops_->move(storage_, other.storage_);
+            ops_ = std::exchange(other.ops_, nullptr);
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[InlineSize];
+    const Ops *ops_ = nullptr;
+};
+
+namespace detail
+{
+
+constexpr unsigned log2Exact(std::uint64_t value)
+{
+    unsigned bits = 0;
+    while ((std::uint64_t(1) << bits) < value)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+/* Slot layout of a wheel with the given level sizes, all computed at compile time */
+template <std::uint32_t... Sizes>
+struct WheelGeometry
+{
+    static constexpr std::size_t levels = sizeof...(Sizes);
+    static constexpr std::array<std::uint32_t, levels> size = { Sizes... };
+    static constexpr std::array<unsigned, levels> bits = { log2Exact(Sizes)... };
+
+    /* tick bits below level k */
+    static constexpr std::array<unsigned, levels> shift = []
+    {
+        std::array<unsigned, levels> result {};
+        unsigned total = 0;
+        for (std::size_t k = 0; k < levels; k++)
+        {
+            result[k] = total;
+            total += bits[k];
+        }
+        return result;
+    }();
+
+    /* first slot of level k in the flat slot array */
+    static constexpr std::array<std::uint32_t, levels> offset = []
+    {
+        std::array<std::uint32_t, levels> result {};
+        std::uint32_t total = 0;
+        for (std::size_t k = 0; k < levels; k++)
+        {
+            result[k] = total;
+            total += size[k];
+        }
+        return result;
+    }();
+
+    static constexpr unsigned totalBits = shift[levels - 1] + bits[levels - 1];
+    static constexpr std::uint32_t slots = offset[levels - 1] + size[levels - 1];
+};
+
+#ifdef TIMEWHEEL_HPP_COROUTINES
+
+/* resumes a coroutine inline, or hands it to an executor's post(std::coroutine_handle<>) */
+struct Resumer
+{
+    void *executor = nullptr;
+    void (*post)(void *executor, std::coroutine_handle<> handle) = nullptr;
+
+    void operator()(std::coroutine_handle<> handle) const
+    {
+        if (post != nullptr)
+        {
+            post(executor, handle);
+        }
+        else
+        {
+            handle.resume();
+        }
+    }
+};
+
+template <typename Executor>
+Resumer postTo(Executor &executor) noexcept
+{
+    return { &executor, [](void *target, std::coroutine_handle<> handle)
+    {
+        static_cast<Executor*>(target)->post(handle);
+    } };
+}
+
+template <typename A>
+decltype(auto) getAwaiter(A &&awaitable)
+{
+    if constexpr (requires { std::forward<A>(awaitable).operator co_await(); })
+    {
+        return std::forward<A>(awaitable).operator co_await();
+    }
+    else if constexpr (requires { operator co_await(std::forward<A>(awaitable)); })
+    {
+        return operator co_await(std::forward<A>(awaitable));
+    }
+    else
+    {
+        return std::forward<A>(awaitable);
+    }
+}
+
+/* type of co_await on an A */
+template <typename A>
+using AwaitResult = decltype(getAwaiter(std::declval<A>()).await_resume());
+
+#endif /* TIMEWHEEL_HPP_COROUTINES */
+
+} // namespace detail
+
+#ifdef TIMEWHEEL_HPP_COROUTINES
+
+/* Return type of a coroutine nobody awaits: it starts at once and frees its own frame when done */
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+#endif /* TIMEWHEEL_HPP_COROUTINES */
+
+template <std::uint64_t TickNs, std::uint32_t... LevelSizes>
+class TimeWheel
+{
+    using Geometry = detail::WheelGeometry<LevelSizes...>;
+
+    static_assert(TickNs > 0, "the tick must be at least one nanosecond");
+    static_assert(sizeof...(LevelSizes) > 0, "a wheel needs at least one level");
+    static_assert(((LevelSizes >= 2 && (LevelSizes & (LevelSizes - 1)) == 0) && ...), "level sizes must be powers of two");
+    static_assert(Geometry::totalBits < 64, "the levels must cover fewer than 2^64 ticks");
+
+public:
+    using Clock = std::chrono::steady_clock;
+    using Ticks = std::chrono::duration<std::int64_t, std::ratio<TickNs, 1000000000>>;
+
+    /* generation << 32 | pool index, 0 is never valid */
+    using TimerId = std::uint64_t;
+
+    static constexpr std::uint64_t tickNs = TickNs;
+    static constexpr std::uint64_t rangeTicks = std::uint64_t(1) << Geometry::totalBits; /* longer timers go round again */
+
+    /* Owns a timer, cancels it when destroyed or reassigned. Must not outlive the wheel */
+    class [[nodiscard]] TimerHandle
+    {
+    public:
+        TimerHandle() noexcept = default;
+
+        TimerHandle(TimerHandle &&other) noexcept :
+                wheel_(std::exchange(other.wheel_, nullptr)), id_(other.id_)
+        {
+        }
+
+        TimerHandle& operator=(TimerHandle &&other) noexcept
+        {
+            if (this != &other)
+            {
+                cancel();
+                wheel_ = std::exchange(other.wheel_, nullptr);
+                id_ = other.id_;
+            }
+            return *this;
+        }
+
+        TimerHandle(const TimerHandle&) = delete;
+        TimerHandle& operator=(const TimerHandle&) = delete;
+
+        ~TimerHandle()
+        {
+            cancel();
+        }
+
+        /* false if the timer already finished */
+        bool cancel() noexcept
+        {
+            return wheel_ != nullptr && std::exchange(wheel_, nullptr)->cancel(id_);
+        }
+
+        /* let the timer run on its own, it can still be cancelled through the id */
+        TimerId release() noexcept
+        {
+            wheel_ = nullptr;
+            return id_;
+        }
+
+        bool active() const noexcept
+        {
+            return wheel_ != nullptr && wheel_->active(id_);
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return active();
+        }
+
+        TimerId id() const noexcept
+        {
+            return id_;
+        }
+
+    private:
+        friend class TimeWheel;
+
+        TimerHandle(TimeWheel *wheel, TimerId id) noexcept :
+                wheel_(wheel), id_(id)
+        {
+        }
+
+        TimeWheel *wheel_ = nullptr;
+        TimerId id_ = 0;
+    };
+
+#ifdef TIMEWHEEL_HPP_COROUTINES
+    /*
+     * co_await wheel.sleep_for(d). The timer callback only captures the
+     * awaiter, which lives in the suspended coroutine's frame, so a sleeping
+     * coroutine costs one timer node and nothing else. Destroying the frame
+     * while it sleeps cancels the timer.
+     */
+    class [[nodiscard]] SleepAwaiter
+    {
+    public:
+        /* only before it is awaited */
+        SleepAwaiter(SleepAwaiter &&other) noexcept = default;
+        SleepAwaiter& operator=(SleepAwaiter&&) = delete;
+
+        ~SleepAwaiter()
+        {
+            if (id_ != 0)
+            {
+                wheel_->cancel(id_);
+            }
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            handle_ = handle;
+            id_ = wheel_->schedule(delayTicks_, 0, [this]
+            {
+                fire();
+            });
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+
+    private:
+        friend class TimeWheel;
+
+        SleepAwaiter(TimeWheel *wheel, std::uint64_t delayTicks, detail::Resumer resumer) noexcept :
+                wheel_(wheel), delayTicks_(delayTicks), resumer_(resumer)
+        {
+        }
+
+        void fire()
+        {
+            /* the coroutine may finish, and destroy this, before resuming returns */
+            std::coroutine_handle<> handle = handle_;
+            detail::Resumer resumer = resumer_;
+
+            id_ = 0;
+            resumer(handle);
+        }
+
+        TimeWheel *wheel_;
+        std::uint64_t delayTicks_;
+        detail::Resumer resumer_;
+        std::coroutine_handle<> handle_;
+        TimerId id_ = 0;
+    };
+
+    /*
+     * co_await wheel.with_timeout(op, d) awaits op and yields its result as
+     * a std::optional, or a bool for a void op, that is empty if d passed
+     * first. The op is moved into a detached coroutine of its own; after a
+     * timeout it keeps running there and its result is dropped, so it must
+     * not refer to the awaiting frame. It has to complete on the thread
+     * that drives the wheel.
+     */
+    template <typename Op>
+    class [[nodiscard]] TimeoutAwaiter
+    {
+        using Value = detail::AwaitResult<Op&&>;
+        using Stored = std::conditional_t<std::is_void_v<Value>, bool, std::decay_t<Value>>;
+
+        /* lives in the driving coroutine, cleared once nobody waits for the op */
+        struct Link
+        {
+            TimeoutAwaiter *waiter;
+        };
+
+    public:
+        /* only before it is awaited */
+        TimeoutAwaiter(TimeoutAwaiter &&other) = default;
+        TimeoutAwaiter& operator=(TimeoutAwaiter&&) = delete;
+
+        ~TimeoutAwaiter()
+        {
+            if (link_ != nullptr)
+            {
+                /* the awaiting frame was destroyed, the op goes on alone */
+                link_->waiter = nullptr;
+                wheel_->cancel(timer_);
+            }
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        /* false, and no suspension, when the op finishes without suspending */
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            handle_ = handle;
+            timer_ = wheel_->schedule(delayTicks_, 0, [this]
+            {
+                expire();
+            });
+
+            starting_ = true;
+            try
+            {
+                drive(std::move(op_), this);
+            }
+            catch (...)
+            {
+                wheel_->cancel(timer_);
+                throw;
+            }
+            starting_ = false;
+
+            return link_ != nullptr;
+        }
+
+        auto await_resume()
+        {
+            if (error_)
+            {
+                std::rethrow_exception(error_);
+            }
+
+            if constexpr (std::is_void_v<Value>)
+            {
+                return result_.has_value();
+            }
+            else
+            {
+                return std::move(result_);
+            }
+        }
+
+    private:
+        friend class TimeWheel;
+
+        template <typename O>
+        TimeoutAwaiter(TimeWheel *wheel, O &&op, std::uint64_t delayTicks) :
+                wheel_(wheel), op_(std::forward<O>(op)), delayTicks_(delayTicks)
+        {
+        }
+
+        static Detached drive(Op op, TimeoutAwaiter *waiter)
+        {
+            Link link { waiter };
+            waiter->link_ = &link;
+
+            try
+            {
+                if constexpr (std::is_void_v<Value>)
+                {
+                    co_await std::move(op);
+                    if (link.waiter != nullptr)
+                    {
+                        link.waiter->result_.emplace(true);
+                    }
+                }
+                else
+                {
+                    Value value = co_await std::move(op);
+                    if (link.waiter != nullptr)
+                    {
+                        link.waiter->result_.emplace(std::forward<Value>(value));
+                    }
+                }
+            }
+            catch (...)
+            {
+                if (link.waiter != nullptr)
+                {
+                    link.waiter->error_ = std::current_exception();
+                }
+            }
+
+            if (link.waiter != nullptr)
+            {
+                link.waiter->complete();
+            }
+        }
+
+        void complete()
+        {
+            link_ = nullptr;
+            wheel_->cancel(timer_);
+            if (!starting_)
+            {
+                handle_.resume();
+            }
+        }
+
+        void expire()
+        {
+            link_->waiter = nullptr;
+            link_ = nullptr;
+            handle_.resume();
+        }
+
+        TimeWheel *wheel_;
+        Op op_;
+        std::uint64_t delayTicks_;
+        std::coroutine_handle<> handle_;
+        TimerId timer_ = 0;
+        Link *link_ = nullptr;
+        bool starting_ = false;
+        std::optional<Stored> result_;
+        std::exception_ptr error_;
+    };
+#endif /* TIMEWHEEL_HPP_COROUTINES */
+
+    TimeWheel() :
+            start_(Clock::now())
+    {
+        for (Slot &slot : slots_)
+        {
+            slot.head = None;
+            slot.tail = None;
+        }
+        grow();
+    }
+
+    TimeWheel(const TimeWheel&) = delete;
+    TimeWheel& operator=(const TimeWheel&) = delete;
+
+    /* one-shot timer due delay from now, rounded up to whole ticks */
+    template <typename Rep, typename Period, typename F>
+    TimerHandle add(std::chrono::duration<Rep, Period> delay, F &&f)
+    {
+        return TimerHandle(this, schedule(toTicks(delay), 0, TimerCallback(std::forward<F>(f))));
+    }
+
+    /* periodic timer, first due one interval from now */
+    template <typename Rep, typename Period, typename F>
+    TimerHandle add_periodic(std::chrono::duration<Rep, Period> interval, F &&f)
+    {
+        std::uint64_t ticks = toTicks(interval);
+        return TimerHandle(this, schedule(ticks, ticks, TimerCallback(std::forward<F>(f))));
+    }
+
+#ifdef TIMEWHEEL_HPP_COROUTINES
+    /* resumes the awaiting coroutine from poll()/advance(), on the thread driving the wheel */
+    template <typename Rep, typename Period>
+    SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> delay) noexcept
+    {
+        return SleepAwaiter(this, toTicks(delay), {});
+    }
+
+    /* hands the coroutine to executor.post(std::coroutine_handle<>) instead, the executor must outlive the sleep */
+    template <typename Rep, typename Period, typename Executor>
+    SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> delay, Executor &executor) noexcept
+    {
+        return SleepAwaiter(this, toTicks(delay), detail::postTo(executor));
+    }
+
+    SleepAwaiter sleep_until(Clock::time_point deadline) noexcept
+    {
+        return SleepAwaiter(this, ticksUntil(deadline), {});
+    }
+
+    template <typename Executor>
+    SleepAwaiter sleep_until(Clock::time_point deadline, Executor &executor) noexcept
+    {
+        return SleepAwaiter(this, ticksUntil(deadline), detail::postTo(executor));
+    }
+
+    template <typename Op, typename Rep, typename Period>
+    TimeoutAwaiter<std::decay_t<Op>> with_timeout(Op &&op, std::chrono::duration<Rep, Period> timeout)
+    {
+        return TimeoutAwaiter<std::decay_t<Op>>(this, std::forward<Op>(op), toTicks(timeout));
+    }
+#endif /* TIMEWHEEL_HPP_COROUTINES */
+
+    /*
+     * Timer due delayTicks from now, then every periodTicks if that is not
+     * 0. The id is owned by the caller, cancel() it or let a one-shot run out.
+     */
+    TimerId schedule(std::uint64_t delayTicks, std::uint64_t periodTicks, TimerCallback cb)
+    {
+        std::uint32_t index = allocate();
+        Node &node = nodeAt(index);
+
+        node.cb = std::move(cb);
+        node.expires = now_ + (delayTicks == 0 ? 1 : delayTicks);
+        node.period = periodTicks;
+        link(index, node);
+        size_++;
+
+        return (TimerId(node.generation) << 32) | index;
+    }
+
+    /* false if the id is stale, a timer cancelling itself from its callback stops repeating */
+    bool cancel(TimerId id) noexcept
+    {
+        Node *node = lookup(id);
+        if (node == nullptr)
+        {
+            return false;
+        }
+
+        if (node->state == State::Firing)
+        {
+            /* released by finishFire() once the callback returns */
+            node->state = State::Cancelled;
+            return true;
+        }
+
+        unlink(*node);
+        release(static_cast<std::uint32_t>(id), *node);
+        return true;
+    }
+
+    bool active(TimerId id) const noexcept
+    {
+        return lookup(id) != nullptr;
+    }
+
+    /* run everything due up to Clock::now(), returns the number of callbacks */
+    std::size_t poll()
+    {
+        return advance_to(static_cast<std::uint64_t>(std::chrono::duration_cast<Ticks>(Clock::now() - start_).count()));
+    }
+
+    std::size_t advance(std::uint64_t ticks)
+    {
+        return advance_to(now_ + ticks);
+    }
+
+    /*
+     * Step to tick target, skipping empty stretches of the first level. A
+     * tick whose first-level position wraps to 0 first cascades the slot of
+     * every level that wrapped with it.
+     */
+    std::size_t advance_to(std::uint64_t target)
+    {
+        constexpr std::uint64_t mask0 = Geometry::size[0] - 1;
+        std::size_t fired = 0;
+
+        while (now_ < target)
+        {
+            if (size_ == 0)
+            {
+                now_ = target;
+                break;
+            }
+
+            std::uint64_t wrap = (now_ | mask0) + 1;
+            std::uint64_t next = nextOccupied0(now_ + 1, wrap);
+            if (next > target)
+            {
+                now_ = target;
+                break;
+            }
+
+            now_ = next;
+            if ((now_ & mask0) == 0)
+            {
+                cascade();
+            }
+            fired += runSlot(static_cast<std::uint32_t>(now_ & mask0));
+        }
+
+        return fired;
+    }
+
+    /* tick the wheel is at, counted from construction */
+    std::uint64_t now() const noexcept
+    {
+        return now_;
+    }
+
+    /* latest time the owner may sleep until, poll() there and ask again */
+    Clock::time_point next_wakeup() const noexcept
+    {
+        if (size_ == 0)
+        {
+            return Clock::time_point::max();
+        }
+
+        constexpr std::uint64_t mask0 = Geometry::size[0] - 1;
+        return start_ + Ticks(static_cast<std::int64_t>(nextOccupied0(now_ + 1, (now_ | mask0) + 1)));
+    }
+
+    /* next_wakeup() as an epoll/poll timeout, -1 while the wheel is empty */
+    int next_timeout_ms() const noexcept
+    {
+        Clock::time_point wakeup = next_wakeup();
+        if (wakeup == Clock::time_point::max())
+        {
+            return -1;
+        }
+
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(wakeup - Clock::now()).count();
+        return ms <= 0 ? 0 : ms > std::numeric_limits<int>::max() ? std::numeric_limits<int>::max() : static_cast<int>(ms);
+    }
+
+    /* timers scheduled and not finished or cancelled */
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    template <typename Rep, typename Period>
+    static std::uint64_t toTicks(std::chrono::duration<Rep, Period> duration)
+    {
+        auto ticks = std::chrono::ceil<Ticks>(duration).count();
+        return ticks <= 0 ? 1 : static_cast<std::uint64_t>(ticks);
+    }
+
+private:
+    static constexpr std::uint32_t None = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint32_t ChunkShift = 10;
+    static constexpr std::uint32_t ChunkSize = std::uint32_t(1) << ChunkShift;
+    static constexpr std::uint32_t Words0 = (Geometry::size[0] + 63) / 64;
+
+    enum class State : std::uint8_t
+    {
+        Free,
+        Linked, /* in slots_[slot] */
+        Firing, /* taken off its slot by runSlot() */
+        Cancelled, /* cancelled from its own callback */
+    };
+
+    struct Node
+    {
+        TimerCallback cb;
+        std::uint64_t expires = 0; /* absolute tick */
+        std::uint64_t period = 0; /* ticks, 0 for a one-shot timer */
+        std::uint32_t next = None; /* slot list or free list */
+        std::uint32_t prev = None;
+        std::uint32_t slot = None;
+        std::uint32_t generation = 1; /* never 0, so ids are never 0 */
+        State state = State::Free;
+    };
+
+    struct Slot
+    {
+        std::uint32_t head;
+        std::uint32_t tail;
+    };
+
+    Node& nodeAt(std::uint32_t index) noexcept
+    {
+        return chunks_[index >> ChunkShift][index & (ChunkSize - 1)];
+    }
+
+    const Node& nodeAt(std::uint32_t index) const noexcept
+    {
+        return chunks_[index >> ChunkShift][index & (ChunkSize - 1)];
+    }
+
+    Node* lookup(TimerId id) noexcept
+    {
+        return const_cast<Node*>(static_cast<const TimeWheel*>(this)->lookup(id));
+    }
+
+    const Node* lookup(TimerId id) const noexcept
+    {
+        std::uint32_t index = static_cast<std::uint32_t>(id);
+        if (index >= chunks_.size() * ChunkSize)
+        {
+            return nullptr;
+        }
+
+        const Node &node = nodeAt(index);
+        if (node.generation != static_cast<std::uint32_t>(id >> 32) || node.state == State::Free ||
+                node.state == State::Cancelled)
+        {
+            return nullptr;
+        }
+        return &node;
+    }
+
+    /* chunks never move, so a callback adding timers does not invalidate the node being fired */
+    void grow()
+    {
+        std::uint32_t base = static_cast<std::uint32_t>(chunks_.size()) * ChunkSize;
+
+        chunks_.emplace_back(new Node[ChunkSize]);
+        Node *chunk = chunks_.back().get();
+        for (std::uint32_t i = ChunkSize; i-- > 0;)
+        {
+            chunk[i].next = freeList_;
+            freeList_ = base + i;
+        }
+    }
+
+    /* ticks from the wheel's current tick to deadline, 0 if it has passed */
+    std::uint64_t ticksUntil(Clock::time_point deadline) const noexcept
+    {
+        auto tick = std::chrono::ceil<Ticks>(deadline - start_).count();
+        return tick > 0 && static_cast<std::uint64_t>(tick) > now_ ? static_cast<std::uint64_t>(tick) - now_ : 0;
+    }
+
+    std::uint32_t allocate()
+    {
+        if (freeList_ == None)
+        {
+            grow();
+        }
+
+        std::uint32_t index = freeList_;
+        freeList_ = nodeAt(index).next;
+        return index;
+    }
+
+    void release(std::uint32_t index, Node &node) noexcept
+    {
+        node.cb.reset();
+        node.state = State::Free;
+        node.generation = node.generation + 1 == 0 ? 1 : node.generation + 1;
+        node.next = freeList_;
+        freeList_ = index;
+        size_--;
+    }
+
+    /*
+     * The lowest level whose range from now covers the expiry, at the slot
+     * of the expiry's bits for that level. The slot is reached, and cascades
+     * or fires the event, no later than the expiry.
+     */
+    void link(std::uint32_t index, Node &node) noexcept
+    {
+        std::uint64_t expires = node.expires < now_ ? now_ : node.expires;
+        if (expires - now_ >= rangeTicks)
+        {
+            /* parked in the last slot of this round, placed again when it cascades */
+            expires = now_ + rangeTicks - 1;
+        }
+
+        std::uint64_t delta = expires - now_;
+        std::size_t level = 0;
+        while (level + 1 < Geometry::levels && (delta >> (Geometry::shift[level] + Geometry::bits[level])) != 0)
+        {
+            level++;
+        }
+
+        std::uint32_t slotIndex = Geometry::offset[level] +
+                static_cast<std::uint32_t>((expires >> Geometry::shift[level]) & (Geometry::size[level] - 1));
+        Slot &slot = slots_[slotIndex];
+
+        node.slot = slotIndex;
+        node.state = State::Linked;
+        node.next = None;
+        node.prev = slot.tail;
+        if (slot.tail == None)
+        {
+            slot.head = index;
+        }
+        else
+        {
+            nodeAt(slot.tail).next = index;
+        }
+        slot.tail = index;
+
+        if (slotIndex < Geometry::size[0])
+        {
+            occupied0_[slotIndex >> 6] |= std::uint64_t(1) << (slotIndex & 63);
+        }
+    }
+
+    void unlink(Node &node) noexcept
+    {
+        Slot &slot = slots_[node.slot];
+
+        if (node.prev == None)
+        {
+            slot.head = node.next;
+        }
+        else
+        {
+            nodeAt(node.prev).next = node.next;
+        }
+
+        if (node.next == None)
+        {
+            slot.tail = node.prev;
+        }
+        else
+        {
+            nodeAt(node.next).prev = node.prev;
+        }
+
+        if (slot.head == None && node.slot < Geometry::size[0])
+        {
+            occupied0_[node.slot >> 6] &= ~(std::uint64_t(1) << (node.slot & 63));
+        }
+        node.next = None;
+        node.prev = None;
+    }
+
+    /* first tick in [from, wrap) whose first-level slot is occupied, wrap if there is none */
+    std::uint64_t nextOccupied0(std::uint64_t from, std::uint64_t wrap) const noexcept
+    {
+        constexpr std::uint64_t mask0 = Geometry::size[0] - 1;
+
+        if (from >= wrap)
+        {
+            return wrap;
+        }
+
+        std::uint32_t bit = static_cast<std::uint32_t>(from & mask0);
+        for (std::uint32_t w = bit >> 6; w < Words0; w++)
+        {
+            std::uint64_t bits = occupied0_[w] & (w == (bit >> 6) ? ~std::uint64_t(0) << (bit & 63) : ~std::uint64_t(0));
+            if (bits != 0)
+            {
+                std::uint64_t found = (from & ~mask0) + (std::uint64_t(w) << 6) + static_cast<unsigned>(__builtin_ctzll(bits));
+                return found < wrap ? found : wrap;
+            }
+        }
+
+        return wrap;
+    }
+
+    /* now_ just wrapped the first level: redistribute the slot of every level that wrapped with it */
+    void cascade() noexcept
+    {
+        for (std::size_t level = 1; level < Geometry::levels; level++)
+        {
+            std::uint32_t local = static_cast<std::uint32_t>((now_ >> Geometry::shift[level]) & (Geometry::size[level] - 1));
+            Slot &slot = slots_[Geometry::offset[level] + local];
+            std::uint32_t index = slot.head;
+
+            slot.head = None;
+            slot.tail = None;
+            while (index != None)
+            {
+                Node &node = nodeAt(index);
+                std::uint32_t next = node.next;
+                link(index, node);
+                index = next;
+            }
+
+            if (local != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    std::size_t runSlot(std::uint32_t slotIndex)
+    {
+        Slot &slot = slots_[slotIndex];
+        std::size_t fired = 0;
+
+        /* one node at a time, a callback may cancel or add timers in this very slot */
+        while (slot.head != None)
+        {
+            std::uint32_t index = slot.head;
+            Node &node = nodeAt(index);
+
+            unlink(node);
+            if (node.expires > now_)
+            {
+                /* went round the wheel, not due yet */
+                link(index, node);
+                continue;
+            }
+
+            node.state = State::Firing;
+            FireGuard guard { this, index };
+            node.cb();
+            fired++;
+        }
+
+        return fired;
+    }
+
+    /* after a callback, even one that threw: repeat the timer or give its node back */
+    struct FireGuard
+    {
+        TimeWheel *wheel;
+        std::uint32_t index;
+
+        ~FireGuard()
+        {
+            Node &node = wheel->nodeAt(index);
+
+            if (node.state == State::Firing && node.period != 0)
+            {
+                node.expires += node.period;
+                wheel->link(index, node);
+            }
+            else
+            {
+                wheel->release(index, node);
+            }
+        }
+    };
+
+    std::array<Slot, Geometry::slots> slots_;
+    std::array<std::uint64_t, Words0> occupied0_ {};
+    std::vector<std::unique_ptr<Node[]>> chunks_;
+    std::uint32_t freeList_ = None;
+    std::uint64_t now_ = 0;
+    std::size_t size_ = 0;
+    Clock::time_point start_;
+};
+
+} // namespace mycpp
+
+#endif /* TIMEWHEEL_HPP */